@@ -0,0 +1,147 @@
+#include "batch.h"
+
+#include <filesystem>
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdio>
+
+// The checkpoint is a single line: the range, the shard, the next index
+// to do, and how many bytes of output there were before it.
+
+// Makes sure that what's been written to the file is on disk.
+static bool sync_file(const std::string & filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		return false;
+	}
+	bool synced = fsync(fd) == 0;
+	close(fd);
+	return synced;
+}
+
+void batch_shard::write_checkpoint() {
+	// The checkpoint mustn't get to the disk before the output it
+	// vouches for.
+	output.flush();
+	if (!output || !sync_file(output_filename)) {
+		throw std::runtime_error("batch_shard: Could not write to " +
+			output_filename);
+	}
+
+	// Write to a temporary file and rename it over the old one, so
+	// that there's always a complete checkpoint, even if we crash.
+	std::string temp_filename = checkpoint_filename + ".tmp";
+	std::ofstream checkpoint(temp_filename);
+	checkpoint << range.first << " " << range.count << " " << range.shards
+		<< " " << shard << " " << next_index << " " << output.tellp()
+		<< std::endl;
+	checkpoint.close();
+
+	if (!checkpoint || !sync_file(temp_filename) ||
+		std::rename(temp_filename.c_str(),
+			checkpoint_filename.c_str()) != 0) {
+		throw std::runtime_error("batch_shard: Could not write " +
+			checkpoint_filename);
+	}
+
+	unsaved_records = 0;
+	last_checkpoint = std::chrono::steady_clock::now();
+}
+
+batch_shard::batch_shard(const std::string & prefix,
+	const batch_range & range_in, int shard_in,
+	const std::string & extension, const std::string & header) {
+
+	if (range_in.shards <= 0 || shard_in < 0 || shard_in >= range_in.shards) {
+		throw std::logic_error("batch_shard: Invalid shard");
+	}
+
+	range = range_in;
+	shard = shard_in;
+	next_index = range.first + shard;
+
+	std::string name = prefix + "." + std::to_string(shard);
+	output_filename = name + "." + extension;
+	checkpoint_filename = name + ".checkpoint";
+
+	std::ifstream checkpoint(checkpoint_filename);
+
+	if (!checkpoint) {
+		if (std::filesystem::exists(output_filename)) {
+			throw std::runtime_error("batch_shard: " + output_filename +
+				" exists, but there's no checkpoint for it");
+		}
+		output.open(output_filename, std::ios::binary);
+		output << header;
+		output.flush();
+		if (!output) {
+			throw std::runtime_error("batch_shard: Could not open " +
+				output_filename);
+		}
+		write_checkpoint();
+		return;
+	}
+
+	batch_range checkpoint_range;
+	int checkpoint_shard;
+	uintmax_t output_bytes;
+
+	checkpoint >> checkpoint_range.first >> checkpoint_range.count
+		>> checkpoint_range.shards >> checkpoint_shard >> next_index
+		>> output_bytes;
+
+	if (!checkpoint) {
+		throw std::runtime_error("batch_shard: Could not read " +
+			checkpoint_filename);
+	}
+
+	if (checkpoint_range.first != range.first ||
+		checkpoint_range.count != range.count ||
+		checkpoint_range.shards != range.shards ||
+		checkpoint_shard != shard) {
+		throw std::runtime_error("batch_shard: " + checkpoint_filename +
+			" is for a different range or number of shards");
+	}
+
+	// Cut off anything written after the checkpoint.
+	if (!std::filesystem::exists(output_filename) ||
+		std::filesystem::file_size(output_filename) < output_bytes) {
+		throw std::runtime_error("batch_shard: " + output_filename +
+			" is shorter than its checkpoint says");
+	}
+	std::filesystem::resize_file(output_filename, output_bytes);
+
+	output.open(output_filename, std::ios::binary | std::ios::app);
+	if (!output) {
+		throw std::runtime_error("batch_shard: Could not open " +
+			output_filename);
+	}
+	output.seekp(0, std::ios::end);
+	last_checkpoint = std::chrono::steady_clock::now();
+}
+
+uint64_t batch_shard::get_completed() const {
+	return (next_index - range.first - shard) / range.shards;
+}
+
+void batch_shard::write(const std::string & record) {
+	if (done()) {
+		throw std::logic_error("batch_shard: Shard is already done");
+	}
+
+	output << record;
+	if (!output) {
+		throw std::runtime_error("batch_shard: Could not write to " +
+			output_filename);
+	}
+
+	next_index += range.shards;
+	++unsaved_records;
+
+	if (done() || unsaved_records >= CHECKPOINT_RECORDS ||
+		std::chrono::steady_clock::now() - last_checkpoint >=
+			std::chrono::seconds(CHECKPOINT_SECONDS)) {
+		write_checkpoint();
+	}
+}
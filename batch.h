@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <chrono>
+
+// Batch generation over a range of board indices. The range is split
+// into shards, shard k taking every shards-th index starting at
+// first + k, so that the shards take about as long as each other.
+// Each shard has its own output file and checkpoint, so shards can be
+// run by different threads (or processes) without any locking, and a
+// shard that's interrupted picks up where it left off.
+
+// The checkpoint records how long the output was, and the output is
+// synced to disk before the checkpoint is. When resuming, anything after
+// that length is cut off and done again, so nothing is ever lost or
+// written twice. Checkpointing after every record would cost a handful
+// of system calls per board, which adds up on small boards, so it's done
+// every CHECKPOINT_RECORDS records or CHECKPOINT_SECONDS seconds, and
+// when the shard is done. A crash loses at most that much work.
+
+const int CHECKPOINT_RECORDS = 1000;
+const int CHECKPOINT_SECONDS = 30;
+
+struct batch_range {
+	uint64_t first = 0, count = 0;
+	int shards = 1;
+};
+
+class batch_shard {
+	private:
+		batch_range range;
+		int shard;
+
+		std::string output_filename, checkpoint_filename;
+		std::ofstream output;
+
+		uint64_t next_index;
+
+		// Records written since the last checkpoint, and when that was.
+		int unsaved_records = 0;
+		std::chrono::steady_clock::time_point last_checkpoint;
+
+		void write_checkpoint();
+
+	public:
+		// Opens the shard's output (prefix.shard.extension) and
+		// checkpoint (prefix.shard.checkpoint), resuming if there's a
+		// checkpoint. A new output file starts with the header.
+		// Throws if the checkpoint is for a different range, or if
+		// there's output without a checkpoint, as then it's not ours.
+		batch_shard(const std::string & prefix, const batch_range & range_in,
+			int shard_in, const std::string & extension,
+			const std::string & header = "");
+
+		bool done() const {
+			return next_index >= range.first + range.count;
+		}
+
+		// The index that the next record should be for.
+		uint64_t get_next_index() const { return next_index; }
+
+		// How many indices were already done when we resumed, or
+		// have been done since.
+		uint64_t get_completed() const;
+
+		const std::string & get_output_filename() const {
+			return output_filename;
+		}
+
+		// Append the record for get_next_index() and move on to the
+		// next index.
+		void write(const std::string & record);
+};
@@ -0,0 +1,281 @@
+// Benchmark for the generator and solver. For every board size from
+// 4x4 to 7x7, this grows the boards with a fixed range of indices the
+// same way the main program does, solves them, and reports the time and
+// work taken as JSON. Everything but the timings is deterministic, so
+// the digests can be compared between runs to make sure a change didn't
+// alter any results.
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "generator.h"
+#include "endgame.h"
+#include "board.h"
+#include "solver/all.h"
+
+const int MIN_SIZE = 4, MAX_SIZE = 7;
+
+struct size_result {
+	coord size;
+	int boards = 0, solved = 0, unsolved = 0;
+	double grow_seconds = 0, solve_seconds = 0;
+	uint64_t grow_nodes = 0, solve_nodes = 0;
+	size_t peak_tt_slots = 0, tt_slots = 0;
+	uint64_t digest = 14695981039346656037ULL;
+
+	double get_nodes_per_second() const {
+		double seconds = grow_seconds + solve_seconds;
+		if (seconds == 0) {
+			return 0;
+		}
+		return (grow_nodes + solve_nodes) / seconds;
+	}
+
+	// FNV-1a.
+	void add_to_digest(uint64_t value) {
+		for (int i = 0; i < 8; ++i) {
+			digest ^= (value >> (i * 8)) & 0xFF;
+			digest *= 1099511628211ULL;
+		}
+	}
+
+	size_result & operator+=(const size_result & other) {
+		boards += other.boards;
+		solved += other.solved;
+		unsolved += other.unsolved;
+		grow_seconds += other.grow_seconds;
+		solve_seconds += other.solve_seconds;
+		grow_nodes += other.grow_nodes;
+		solve_nodes += other.solve_nodes;
+		peak_tt_slots = std::max(peak_tt_slots, other.peak_tt_slots);
+		tt_slots = std::max(tt_slots, other.tt_slots);
+		add_to_digest(other.digest);
+		return *this;
+	}
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+// The boards are all grown first, and then solved as a batch by the
+// final solver.
+size_result run_size(coord size, uint64_t first_index, int count,
+	int max_depth, bool retain_transpositions, bool order_moves,
+	int speculation) {
+
+	size_result result;
+	result.size = size;
+
+	dfs_solver dfs;
+	iddfs_solver<dfs_solver> iddfs;
+	const endgame_table * endgame = &endgame_table::get_default();
+	dfs.set_endgame_table(endgame);
+	iddfs.set_endgame_table(endgame);
+	dfs.set_transposition_retention(retain_transpositions);
+	iddfs.set_transposition_retention(retain_transpositions);
+
+	move_ordering dfs_ordering, iddfs_ordering;
+	if (order_moves) {
+		dfs.set_move_ordering(&dfs_ordering);
+		iddfs.set_move_ordering(&iddfs_ordering);
+	}
+
+	// Extra solvers for growing speculatively; see grow_board.
+	std::vector<dfs_solver> extra_dfs(speculation - 1);
+	std::vector<move_ordering> extra_orderings(speculation - 1);
+	std::vector<solver *> guiding_solvers = {&dfs};
+	for (int i = 0; i < speculation - 1; ++i) {
+		extra_dfs[i].set_endgame_table(endgame);
+		extra_dfs[i].set_transposition_retention(retain_transpositions);
+		if (order_moves) {
+			extra_dfs[i].set_move_ordering(&extra_orderings[i]);
+		}
+		guiding_solvers.push_back(&extra_dfs[i]);
+	}
+
+	coord player_pos(0, 3);
+	coord end_square(size.x-1, size.y-1);
+
+	std::vector<zzt_board> boards;
+
+	for (uint64_t index = first_index; index < first_index + count;
+		++index) {
+
+		auto start = std::chrono::steady_clock::now();
+		relaxation_stats grow_stats;
+		boards.push_back(grow_indexed_board(player_pos, end_square,
+			size, max_depth, guiding_solvers, index, &grow_stats));
+		result.grow_seconds += seconds_since(start);
+		result.grow_nodes += grow_stats.search_nodes;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<solve_result> solved = iddfs.solve_batch(boards,
+		std::vector<coord>(boards.size(), end_square), max_depth);
+	result.solve_seconds += seconds_since(start);
+
+	for (size_t i = 0; i < boards.size(); ++i) {
+		const eval_score & score = solved[i].score;
+		result.solve_nodes += solved[i].nodes_visited;
+
+		++result.boards;
+		coord pos;
+		for (pos.y = 0; pos.y < size.y; ++pos.y) {
+			for (pos.x = 0; pos.x < size.x; ++pos.x) {
+				result.add_to_digest(boards[i].get_tile_at(pos));
+			}
+		}
+		result.add_to_digest(score.score);
+		result.add_to_digest(score.solution_length);
+
+		if (score.score == WIN) {
+			++result.solved;
+			for (direction dir: solved[i].solution) {
+				result.add_to_digest(dir);
+			}
+		} else {
+			++result.unsolved;
+		}
+	}
+
+	result.peak_tt_slots = std::max(
+		dfs.get_transposition_table().get_peak_used_slots(),
+		iddfs.get_baseline_solver().get_transposition_table().
+			get_peak_used_slots());
+	result.tt_slots = dfs.get_transposition_table().get_num_slots();
+
+	return result;
+}
+
+void print_json(std::ostream & out, const size_result & result,
+	const std::string & indent) {
+
+	char digest[17];
+	snprintf(digest, sizeof(digest), "%016llx",
+		(unsigned long long)result.digest);
+
+	out << indent << "\"boards\": " << result.boards << ",\n"
+		<< indent << "\"solved\": " << result.solved << ",\n"
+		<< indent << "\"unsolved\": " << result.unsolved << ",\n"
+		<< indent << "\"grow_seconds\": " << result.grow_seconds << ",\n"
+		<< indent << "\"solve_seconds\": " << result.solve_seconds << ",\n"
+		<< indent << "\"wall_seconds\": "
+		<< result.grow_seconds + result.solve_seconds << ",\n"
+		<< indent << "\"grow_nodes\": " << result.grow_nodes << ",\n"
+		<< indent << "\"solve_nodes\": " << result.solve_nodes << ",\n"
+		<< indent << "\"nodes_per_second\": "
+		<< (uint64_t)result.get_nodes_per_second() << ",\n"
+		<< indent << "\"peak_tt_slots\": " << result.peak_tt_slots << ",\n"
+		<< indent << "\"tt_slots\": " << result.tt_slots << ",\n"
+		<< indent << "\"digest\": \"" << digest << "\"";
+}
+
+int main(int argc, char ** argv) {
+	// Index 0 seeds the RNG from the system entropy source, so it's not
+	// reproducible; start at 1.
+	uint64_t first_index = 1;
+	int count = 25;
+	int max_depth = 45;
+	std::string output_filename;
+	bool retain_transpositions = true;
+	bool order_moves = false;
+	int speculation = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 < argc && arg == "--first") {
+			first_index = std::strtoull(argv[++i], nullptr, 10);
+		} else if (i + 1 < argc && arg == "--count") {
+			count = std::atoi(argv[++i]);
+		} else if (i + 1 < argc && arg == "--depth") {
+			max_depth = std::atoi(argv[++i]);
+		} else if (i + 1 < argc && arg == "--output") {
+			output_filename = argv[++i];
+		} else if (i + 1 < argc && arg == "--speculate") {
+			speculation = std::atoi(argv[++i]);
+		} else if (arg == "--clear-tt") {
+			retain_transpositions = false;
+		} else if (arg == "--move-ordering") {
+			order_moves = true;
+		} else {
+			std::cerr << "Usage: " << argv[0] << " [--first INDEX] "
+				"[--count N] [--depth MAX_DEPTH] [--output FILE] "
+				"[--clear-tt] [--move-ordering] [--speculate N]"
+				<< std::endl;
+			return -1;
+		}
+	}
+
+	if (first_index == 0 || count <= 0 || max_depth <= 0 ||
+		speculation <= 0) {
+		std::cerr << "The first index, count, depth and speculation "
+			"must all be positive." << std::endl;
+		return -1;
+	}
+
+	// grow_board prints its progress to cout, which would mess up the
+	// JSON, so silence it while running.
+	std::streambuf * cout_buffer = std::cout.rdbuf(nullptr);
+
+	std::vector<size_result> results;
+	size_result total;
+	coord size;
+
+	for (size.y = MIN_SIZE; size.y <= MAX_SIZE; ++size.y) {
+		for (size.x = MIN_SIZE; size.x <= MAX_SIZE; ++size.x) {
+			std::cerr << "Benchmarking " << size.x << "x" << size.y
+				<< "..." << std::endl;
+			results.push_back(run_size(size, first_index, count,
+				max_depth, retain_transpositions, order_moves,
+				speculation));
+			total += results.back();
+		}
+	}
+
+	std::cout.rdbuf(cout_buffer);
+	std::cout.clear();
+
+	std::ofstream output_file;
+	if (!output_filename.empty()) {
+		output_file.open(output_filename);
+		if (!output_file) {
+			std::cerr << "Could not open " << output_filename << std::endl;
+			return -1;
+		}
+	}
+	std::ostream & out = output_filename.empty() ? std::cout : output_file;
+
+	out << "{\n"
+		<< "  \"first_index\": " << first_index << ",\n"
+		<< "  \"count\": " << count << ",\n"
+		<< "  \"max_depth\": " << max_depth << ",\n"
+		<< "  \"retain_tt\": " << (retain_transpositions ? "true" : "false")
+		<< ",\n"
+		<< "  \"move_ordering\": " << (order_moves ? "true" : "false")
+		<< ",\n"
+		<< "  \"speculation\": " << speculation << ",\n"
+		<< "  \"sizes\": [\n";
+
+	for (size_t i = 0; i < results.size(); ++i) {
+		out << "    {\n"
+			<< "      \"width\": " << results[i].size.x << ",\n"
+			<< "      \"height\": " << results[i].size.y << ",\n";
+		print_json(out, results[i], "      ");
+		out << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "  ],\n"
+		<< "  \"total\": {\n";
+	print_json(out, total, "    ");
+	out << "\n  }\n"
+		<< "}" << std::endl;
+
+	return 0;
+}
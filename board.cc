@@ -1,129 +1,197 @@
 #include "board.h"
+#include "random/random.h"
 
-void zzt_board::generate_zobrist() {
-	// The vector contains one value for each possible tile at each
-	// possible location. TODO later? Use a custom random function
-	// with a fixed seed to make this completely deterministic and
-	// debuggable.
-	zobrist_values = std::vector<std::vector<std::vector<uint64_t> > >(
-		size.y, std::vector<std::vector<uint64_t> >(size.x,
-		std::vector<uint64_t>(NUM_TILE_TYPES, 0)));
-
-	for (auto & row: zobrist_values) {
-		for (auto & column: row) {
-			for (uint64_t & cell: column) {
-				cell = (random() << 32LL) + random();
-			}
-		}
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <map>
+
+zobrist_table::zobrist_table(coord board_size) {
+	// Seed by size so that boards of different sizes get different
+	// values; the seed must never be zero (RNG_ENTROPY).
+	rng prng(1 + board_size.y * (MAX_BOARD_DIM + 1) + board_size.x);
+
+	values = std::vector<uint64_t>(
+		(board_size.x + 2) * (board_size.y + 2) * NUM_TILE_TYPES);
+
+	for (uint64_t & value: values) {
+		value = prng.long_rand();
+	}
+}
+
+const zobrist_table & zobrist_table::for_size(coord board_size) {
+	static std::mutex tables_lock;
+	static std::map<std::pair<int, int>,
+		std::unique_ptr<zobrist_table> > tables;
+
+	std::lock_guard<std::mutex> guard(tables_lock);
+
+	std::unique_ptr<zobrist_table> & table =
+		tables[std::pair<int, int>(board_size.x, board_size.y)];
+
+	if (!table) {
+		table.reset(new zobrist_table(board_size));
 	}
+
+	return *table;
 }
 
-bool zzt_board::pushable(const coord & pos, const coord & delta) const {
-	tile at_pos = get_tile_at(pos);
+// The same as get_delta, but without the check, for the push code.
+static const coord move_deltas[] = {coord(0, -1), coord(0, 1),
+	coord(1, 0), coord(-1, 0)};
+
+bool zzt_board::pushable(int pos, direction dir) const {
+	tile at_pos = board_p[pos];
 
 	switch(at_pos) {
 		case T_EMPTY: return false;
 		case T_PLAYER: return true;
 		case T_SOLID: return false;
-		case T_SLIDEREW: return delta.y == 0; // can't be moved vertically
-		case T_SLIDERNS: return delta.x == 0; // can't be moved horizontally
+		// can't be moved vertically
+		case T_SLIDEREW: return dir == EAST || dir == WEST;
+		// can't be moved horizontally
+		case T_SLIDERNS: return dir == NORTH || dir == SOUTH;
 		case T_BOULDER: return true;
 		default: throw std::runtime_error("Pushable: unknown tile type!");
 	}
 }
 
-bool zzt_board::push(const coord & current_pos, const coord & delta,
-	coord & out_terminus) {
-	// Check if the current tile is pushable.
-	if (!pushable(current_pos, delta)) {
-		 return false;
+void zzt_board::shift_chain(int start, int end, int index_delta) {
+	tile moved = board_p[end];
+
+	for (int i = end; i != start; i -= index_delta) {
+		tile what = board_p[i - index_delta];
+		if (board_p[i] != what) {
+			set_at(i, what);
+		}
 	}
 
-	// Check if the destination tile is an empty: if so, we just have
-	// to move the current tile over there.
-	coord dest_tile = current_pos + delta;
-	if (get_tile_at(dest_tile) == T_EMPTY) {
-		swap(dest_tile, current_pos);
-		out_terminus = dest_tile;
-		return true;
+	set_at(start, moved);
+}
+
+int zzt_board::count_shifted(int start, int end, int index_delta) const {
+	int changed = board_p[end] != board_p[start];
+	for (int i = start; i != end; i += index_delta) {
+		changed += board_p[i] != board_p[i + index_delta];
 	}
+	return changed;
+}
 
-	// Check if the destination tile is pushable. If so, recurse.
-	// If we get a true result, then there will be an empty at the
-	// destination tile and we can move the source tile over there.
-	if (!pushable(dest_tile, delta)) {
-		return false;
+bool zzt_board::push(direction dir, int & chain_length) {
+	int index_delta = get_index_delta(dir),
+		player_idx = get_index(player_pos),
+		end = player_idx + index_delta;
+
+	// Find the empty at the end of the chain in front of the player.
+	// Since the board is surrounded by solids, which aren't pushable,
+	// we never leave the array.
+	chain_length = 0;
+	while (board_p[end] != T_EMPTY) {
+		if (!pushable(end, dir)) {
+			return false;
+		}
+		end += index_delta;
+		++chain_length;
 	}
 
-	if (push(dest_tile, delta, out_terminus)) {
-		swap(dest_tile, current_pos);
-		return true;
-	} else {
+	// Then shift the whole chain, player included, into it.
+	shift_chain(player_idx, end, index_delta);
+	player_pos += move_deltas[dir];
+
+	return true;
+}
+
+void zzt_board::pull(direction dir, int chain_length) {
+	int index_delta = get_index_delta(dir),
+		player_idx = get_index(player_pos);
+
+	// The empty behind the player goes to the end of the chain, and
+	// everything else moves one step back.
+	shift_chain(player_idx + chain_length * index_delta,
+		player_idx - index_delta, -index_delta);
+	player_pos -= move_deltas[dir];
+}
+
+bool zzt_board::do_move(direction dir) {
+	int chain_length;
+	if (!push(dir, chain_length)) {
 		return false;
 	}
+
+	log_move(dir, chain_length);
+	return true;
 }
 
-bool zzt_board::do_move(direction dir) {
-	// Try to push in the direction given. If it works, update the
-	// player position and set the terminus and direction info.
-	// Otherwise just return false.
+std::vector<move_effect> zzt_board::replay(
+	const std::vector<direction> & path) {
 
-	coord out_terminus;
-	if (push(player_pos, dir, out_terminus)) {
-		player_pos += get_delta(dir);
+	std::vector<move_effect> effects;
+	int total_tiles_pushed = 0;
 
-		push_info this_push;
-		this_push.last_push_destination = out_terminus;
-		this_push.player_direction = get_delta(dir);
-		push_log.push_back(this_push);
+	for (direction dir: path) {
+		move_effect effect;
+		effect.dir = dir;
 
-		return true;
-	} else {
-		return false;
+		int start = get_index(player_pos);
+		if (!push(dir, effect.tiles_pushed)) {
+			throw std::runtime_error("replay: Can't make that move!");
+		}
+		log_move(dir, effect.tiles_pushed);
+
+		total_tiles_pushed += effect.tiles_pushed;
+		effect.total_tiles_pushed = total_tiles_pushed;
+
+		int index_delta = get_index_delta(dir);
+		effect.tiles_changed = count_shifted(start,
+			start + (effect.tiles_pushed + 1) * index_delta, index_delta);
+
+		effects.push_back(effect);
 	}
+
+	return effects;
 }
 
 void zzt_board::undo_move() {
-	if (push_log.empty()) {
+	if (push_log_size == 0) {
 		throw std::runtime_error("Tried to undo before any moves were made");
 	}
 
-	// First move the player in the opposite direction, leaving
-	// a gap on the player side of the chain of pushables that
-	// we're undoing.
+	push_log_end = (push_log_end + MAX_UNDO - 1) % MAX_UNDO;
+	--push_log_size;
 
-	// Then push from the terminus in the opposite direction of
-	// the player's earlier movement, which will reset every tile
-	// between the player and the terminus.
+	uint8_t last_move = push_log[push_log_end];
+	pull((direction)(last_move & 3), last_move >> 2);
+}
 
-	// This will throw an exception if anything strange happens.
-	coord last_move_dir_delta = push_log.rbegin()->player_direction;
-	coord opposite_delta = coord(0, 0) - last_move_dir_delta;
-	coord player_new_pos = player_pos + opposite_delta;
+void zzt_board::pack(uint64_t * out) const {
+	std::fill(out, out + get_packed_size(), 0);
 
-	if (get_tile_at(player_new_pos) != T_EMPTY) {
-		throw std::logic_error("Trying to undo move but player can't retrace his steps!");
-	}
-	if (get_tile_at(player_pos) != T_PLAYER) {
-		throw std::logic_error("Player pos is not correct!");
+	coord pos;
+	int i = 0;
+	for (pos.y = 0; pos.y < size.y; ++pos.y) {
+		for (pos.x = 0; pos.x < size.x; ++pos.x, ++i) {
+			out[i / TILES_PER_WORD] |= (uint64_t)board_p[get_index(pos)] <<
+				(3 * (i % TILES_PER_WORD));
+		}
 	}
+}
 
-	set(player_pos, T_EMPTY);
-	set(player_new_pos, T_PLAYER);
-
-	coord throwaway, chain_end = push_log.rbegin()->last_push_destination;
-
-	// Only push the rest of the chain if there's anything to it.
-	// If it's just the player, then skip.
-	if (chain_end != player_pos) {
-		if (!push(chain_end, opposite_delta, throwaway)) {
-			throw std::logic_error("Can't push tiles back into original place!");
+void zzt_board::unpack(const uint64_t * in) {
+	coord pos;
+	int i = 0;
+	for (pos.y = 0; pos.y < size.y; ++pos.y) {
+		for (pos.x = 0; pos.x < size.x; ++pos.x, ++i) {
+			tile what = (tile)((in[i / TILES_PER_WORD] >>
+				(3 * (i % TILES_PER_WORD))) & 7);
+			if (what > T_MAX) {
+				throw std::runtime_error("Unpack: unknown tile!");
+			}
+			set_at(get_index(pos), what);
+			if (what == T_PLAYER) {
+				player_pos = pos;
+			}
 		}
 	}
-
-	player_pos = player_new_pos;
-
-	push_log.pop_back();
 }
 
 void zzt_board::print() const {
@@ -183,6 +251,27 @@ zzt_board board_from_str(coord size, std::string specification) {
 	return output;
 }
 
+std::string board_to_str(const zzt_board & board) {
+	std::string specification;
+	coord pos;
+
+	for (pos.y = 0; pos.y < board.get_size().y; ++pos.y) {
+		for (pos.x = 0; pos.x < board.get_size().x; ++pos.x) {
+			switch(board.get_tile_at(pos)) {
+				case T_EMPTY: specification += '.'; break;
+				case T_SOLID: specification += '#'; break;
+				case T_PLAYER: specification += '@'; break;
+				case T_SLIDEREW: specification += '>'; break;
+				case T_SLIDERNS: specification += '^'; break;
+				case T_BOULDER: specification += 'x'; break;
+				default: specification += '?'; break;
+			}
+		}
+	}
+
+	return specification;
+}
+
 std::string str_direction(direction dir) {
 	switch(dir) {
 		case NORTH: return "N ";
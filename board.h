@@ -2,10 +2,13 @@
 
 #include "coord.h"
 
+#include <algorithm>
 #include <iostream>
+#include <stdint.h>
 #include <vector>
+#include <array>
 
-enum tile	{T_EMPTY = 0, T_PLAYER = 1, T_SOLID = 2,
+enum tile : uint8_t {T_EMPTY = 0, T_PLAYER = 1, T_SOLID = 2,
 	T_SLIDEREW = 3, T_SLIDERNS = 4, T_BOULDER = 5,
 	T_MAX = T_BOULDER};
 
@@ -17,20 +20,63 @@ const tile obstacles[] = { T_SOLID,
 const int NUM_TILE_TYPES = 6;
 const int NUM_OBSTACLES = 4;
 
+// The board is stored as a flat array with a one-tile border of
+// solids around the playing field, so that the push code never has
+// to check if it's walked off the board: it'll just hit a solid.
+// The array has a fixed capacity so that copying a board doesn't
+// touch the heap. Our boards are much smaller than this anyway.
+const int MAX_BOARD_DIM = 14;
+const int MAX_PADDED_TILES = (MAX_BOARD_DIM + 2) * (MAX_BOARD_DIM + 2);
+
+// Number of tiles packed into each word by zzt_board::pack.
+const int TILES_PER_WORD = 21;
+
+// Zobrist hashing values, one for each possible tile at each possible
+// (padded) location. These only depend on the board size, so there's
+// one table per size, shared by every board of that size. The tables
+// are drawn from a fixed seed so that hashes are the same on every
+// run and machine.
+class zobrist_table {
+	private:
+		std::vector<uint64_t> values;
+
+		zobrist_table(coord board_size);
+
+	public:
+		uint64_t get(int index, tile what) const {
+			return values[index * NUM_TILE_TYPES + what];
+		}
+
+		// Returns the table for the given size, creating it if
+		// necessary. This is thread-safe, and the reference stays
+		// valid for the life of the program.
+		static const zobrist_table & for_size(coord board_size);
+};
+
 // This one takes a bit of explaining. When the player moves,
 // he may push a number of tiles in the direction he's moving.
 // These tiles are then all shifted up one to the first empty
 // space (if any; otherwise the move is impossible). Because
 // copying the structure each time we descend in minmax/alpha-beta
 // would be too slow, we need to be able to undo the move, which
-// is exactly the same thing as pushing the whole stack, player
-// included, one step in the opposite direction.
-// Thus we need to know where to start pushing, and what direction
-// the player moved when causing the push; this is what that's for.
-
-struct push_info {
-	coord last_push_destination;
-	coord player_direction;
+// is exactly the same thing as pulling the whole chain, player
+// included, one step back in the opposite direction.
+// Thus we need to know the direction the player moved and how many
+// tiles he pushed; the push log keeps that for the last MAX_UNDO
+// moves, in a byte each. That's more than any search goes deep, and
+// being a fixed array, it doesn't touch the heap when moving or when
+// copying the board.
+const int MAX_UNDO = 256;
+
+// What a move did; see zzt_board::replay.
+struct move_effect {
+	direction dir;
+	// Tiles pushed by this move (so it was a push if there were any),
+	// and by this and every earlier move.
+	int tiles_pushed, total_tiles_pushed;
+	// Squares whose contents changed, including the two the player
+	// moved between.
+	int tiles_changed;
 };
 
 // TODO: relabel to puzzle_board to distinguish from an ordinary ZZT board.
@@ -38,27 +84,75 @@ class zzt_board {
 	private:
 		coord size;
 
+		// Distance between vertically adjacent tiles in board_p,
+		// i.e. the width of the board including the border.
+		int stride;
+
 		// Only access this with set() and get() and in the
 		// constructor!
-		std::vector<std::vector<tile> > board_p;
+		std::array<tile, MAX_PADDED_TILES> board_p;
 
 		// Values for Zobrist hashing.
-		std::vector<std::vector<std::vector<uint64_t> > > zobrist_values;
+		const zobrist_table * zobrist;
 		uint64_t hash;
-		void generate_zobrist();
 
-		bool pushable(const coord & pos, const coord & delta) const;
+		int get_index(const coord & where) const {
+			return (where.y + 1) * stride + where.x + 1;
+		}
 
-		// out_terminus is the last position we push something onto.
-		// See the comment below about last_push_destination.
-		bool push(const coord & current_pos, const coord & delta,
-			coord & out_terminus);
-		bool push(coord & current_pos, direction dir,
-			coord & out_terminus) {
+		int get_index_delta(const coord & delta) const {
+			return delta.y * stride + delta.x;
+		}
 
-			return push(current_pos, get_delta(dir), out_terminus);
+		int get_index_delta(direction dir) const {
+			switch(dir) {
+				case NORTH: return -stride;
+				case SOUTH: return stride;
+				case EAST: return 1;
+				default: return -1;
+			}
 		}
 
+		// Unchecked versions of get_tile_at and set for use by the
+		// push code, which always stays within the border.
+		void set_at(int index, tile what) {
+			hash ^= zobrist->get(index, board_p[index]);
+			board_p[index] = what;
+			hash ^= zobrist->get(index, what);
+		}
+
+		// Move every tile from start up to (but not including) end one
+		// step towards end, and put what was at end at start. Tiles
+		// that are the same as the one they replace aren't rehashed.
+		void shift_chain(int start, int end, int index_delta);
+
+		// After a shift_chain from start to end, count the tiles it
+		// changed: those that differ from the tile after them, going
+		// around from end back to start.
+		int count_shifted(int start, int end, int index_delta) const;
+
+		bool pushable(int pos, direction dir) const;
+
+		// Move the player, pushing what's in front of him, without
+		// logging the move. chain_length is set to the number of
+		// tiles pushed.
+		bool push(direction dir, int & chain_length);
+
+		// Each entry has the direction of the move in the low two
+		// bits and the number of tiles pushed in the rest. The
+		// newest is at push_log_end - 1 (mod MAX_UNDO).
+		std::array<uint8_t, MAX_UNDO> push_log = {};
+		unsigned int push_log_end = 0, push_log_size = 0;
+
+		void log_move(direction dir, int chain_length) {
+			push_log[push_log_end] = dir | (chain_length << 2);
+			push_log_end = (push_log_end + 1) % MAX_UNDO;
+			push_log_size = std::min(push_log_size + 1, (unsigned)MAX_UNDO);
+		}
+
+		// Take back the player's step and pull the chain after him.
+		void pull(direction dir, int chain_length);
+
 	public:
 		coord player_pos;
 
@@ -68,14 +162,15 @@ class zzt_board {
 		// Pretend that the playing field is surrounded by
 		// infinitely many solids.
 		tile get_tile_at(const coord & where) const {
-			if (where.x < 0 || where.y < 0) {
+			if (where.x < -1 || where.y < -1) {
 				return T_SOLID;
 			}
-			if (where.x >= size.x || where.y >= size.y) {
+			if (where.x > size.x || where.y > size.y) {
 				return T_SOLID;
 			}
 
-			return board_p[where.y][where.x];
+			// Everything else, including the border, is in the array.
+			return board_p[get_index(where)];
 		}
 
 		void set(const coord & where, tile what) {
@@ -83,16 +178,12 @@ class zzt_board {
 				where.x >= size.x || where.y >= size.y) {
 				throw std::runtime_error("Set: Tried to set outside board!");
 			}
-			if (what < 0 || what > T_MAX) {
+			if (what > T_MAX) {
 				throw std::runtime_error("Set: Tried to set unknown tile!");
 			}
 			// Unhash the current tile at this position, set the new
 			// tile, and hash it.
-			hash ^= zobrist_values[where.y][where.x][
-				board_p[where.y][where.x]];
-			board_p[where.y][where.x] = what;
-
-			hash ^= zobrist_values[where.y][where.x][(int)what];
+			set_at(get_index(where), what);
 		}
 
 		void swap(const coord & a, const coord & b) {
@@ -102,16 +193,25 @@ class zzt_board {
 		}
 
 		zzt_board(coord player_pos_in, coord board_size) {
+			if (board_size.x > MAX_BOARD_DIM || board_size.y > MAX_BOARD_DIM) {
+				throw std::runtime_error("zzt_board: board is too large!");
+			}
+
 			size = board_size;
-			generate_zobrist();
+			stride = size.x + 2;
+			zobrist = &zobrist_table::for_size(size);
 
-			board_p = std::vector<std::vector<tile > >(board_size.y,
-				std::vector<tile>(board_size.x, T_EMPTY));
+			// Everything starts out solid so that the border is in place;
+			// then we clear the playing field itself.
+			board_p.fill(T_SOLID);
 			hash = 0;
-			// Hash in the Zobrist values of all the empties.
-			for (int y = 0; y < size.y; ++y) {
-				for (int x = 0; x < size.x; ++x) {
-					hash ^= zobrist_values[y][x][(int)T_EMPTY];
+
+			coord pos;
+			for (pos.y = 0; pos.y < size.y; ++pos.y) {
+				for (pos.x = 0; pos.x < size.x; ++pos.x) {
+					// Hash in the Zobrist values of all the empties.
+					board_p[get_index(pos)] = T_EMPTY;
+					hash ^= zobrist->get(get_index(pos), T_EMPTY);
 				}
 			}
 
@@ -123,15 +223,29 @@ class zzt_board {
 		// work. TODO? something more sensible?
 		zzt_board() : zzt_board(coord(0, 0), coord(10, 10)) {}
 
-		std::vector<push_info> push_log;
-		std::vector<push_info>::const_iterator push_log_pos;
-
 		// Move the player in the direction given
 		bool do_move(direction dir);
 
-		// Move the player in the opposite direction
+		// Move the player in the opposite direction. Only the last
+		// MAX_UNDO moves can be undone.
 		void undo_move();
 
+		// Make the moves in path, one after another, and report what
+		// each did. This leaves the board where the moves took it;
+		// they can be undone like any other. Throws if a move can't
+		// be made.
+		std::vector<move_effect> replay(const std::vector<direction> & path);
+
+		// Compact storage for keeping lots of boards around: three
+		// bits per tile, 21 tiles to each 64-bit word, row by row.
+		// get_packed_size() gives the number of words.
+		int get_packed_size() const {
+			return (size.x * size.y + TILES_PER_WORD - 1) / TILES_PER_WORD;
+		}
+		void pack(uint64_t * out) const;
+		// The packed board must be of the same size as this one.
+		void unpack(const uint64_t * in);
+
 		void print() const;
 
 		bool operator==(const zzt_board & other) {
@@ -156,5 +270,7 @@ class zzt_board {
 };
 
 zzt_board board_from_str(coord size, std::string specification);
+// The board as a string that board_from_str can read, row by row.
+std::string board_to_str(const zzt_board & board);
 
 std::string str_direction(direction dir);
\ No newline at end of file
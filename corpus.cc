@@ -0,0 +1,319 @@
+#include "corpus.h"
+#include "generator.h"
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+const char CORPUS_MAGIC[8] = {'Z', 'Z', 'T', 'C', 'O', 'R', 'P', '1'};
+const char CORPUS_INDEX_MAGIC[8] = {'Z', 'Z', 'T', 'C', 'I', 'D', 'X', '1'};
+
+static_assert(sizeof(corpus_header) == 40,
+	"corpus_header must have no padding of its own");
+
+static const int MOVES_PER_WORD = 32;
+
+static size_t get_record_size(const corpus_header & header) {
+	size_t tiles = header.width * header.height;
+	size_t board_words = (tiles + TILES_PER_WORD - 1) / TILES_PER_WORD;
+	size_t move_words = (header.num_moves + MOVES_PER_WORD - 1) /
+		MOVES_PER_WORD;
+
+	return sizeof(corpus_header) + 8 * (board_words + move_words +
+		header.num_stats);
+}
+
+// Maps the whole file read-only, returning nullptr if it's empty.
+static const uint8_t * map_file(const std::string & filename,
+	size_t & size) {
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("corpus: could not open " + filename);
+	}
+
+	struct stat file_info;
+	if (fstat(fd, &file_info) != 0) {
+		close(fd);
+		throw std::runtime_error("corpus: could not stat " + filename);
+	}
+
+	size = file_info.st_size;
+	if (size == 0) {
+		close(fd);
+		return nullptr;
+	}
+
+	void * mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("corpus: could not map " + filename);
+	}
+
+	return (const uint8_t *)mapped;
+}
+
+std::string encode_corpus_entry(const corpus_entry & entry) {
+	const zzt_board & board = entry.board;
+
+	if (entry.solution.size() > UINT16_MAX ||
+		entry.stats.size() > UINT16_MAX) {
+		throw std::runtime_error("encode_corpus_entry: too much to store");
+	}
+
+	corpus_header header;
+	header.index = entry.index;
+	header.seed = entry.seed;
+	header.width = board.get_size().x;
+	header.height = board.get_size().y;
+	header.player_x = board.player_pos.x;
+	header.player_y = board.player_pos.y;
+	header.end_x = entry.end_square.x;
+	header.end_y = entry.end_square.y;
+	header.max_depth = entry.max_depth;
+	header.score = entry.result.score;
+	header.solution_length = entry.result.solution_length;
+	header.num_moves = entry.solution.size();
+	header.num_stats = entry.stats.size();
+
+	std::vector<uint64_t> board_words(board.get_packed_size());
+	board.pack(board_words.data());
+
+	std::vector<uint64_t> move_words((header.num_moves +
+		MOVES_PER_WORD - 1) / MOVES_PER_WORD, 0);
+	for (size_t i = 0; i < entry.solution.size(); ++i) {
+		move_words[i / MOVES_PER_WORD] |= (uint64_t)entry.solution[i] <<
+			(2 * (i % MOVES_PER_WORD));
+	}
+
+	std::string record((const char *)&header, sizeof(header));
+	record.append((const char *)board_words.data(),
+		8 * board_words.size());
+	record.append((const char *)move_words.data(), 8 * move_words.size());
+	record.append((const char *)entry.stats.data(),
+		8 * entry.stats.size());
+
+	return record;
+}
+
+void write_corpus_index(const std::string & corpus_filename) {
+	size_t corpus_size;
+	const uint8_t * corpus = map_file(corpus_filename, corpus_size);
+
+	if (corpus_size < sizeof(CORPUS_MAGIC) ||
+		memcmp(corpus, CORPUS_MAGIC, sizeof(CORPUS_MAGIC)) != 0) {
+		if (corpus) {
+			munmap((void *)corpus, corpus_size);
+		}
+		throw std::runtime_error("corpus: " + corpus_filename +
+			" is not a corpus");
+	}
+
+	std::vector<std::pair<uint64_t, uint64_t> > entries;
+	size_t offset = sizeof(CORPUS_MAGIC);
+
+	while (offset < corpus_size) {
+		corpus_header header;
+		if (corpus_size - offset < sizeof(header)) {
+			break;
+		}
+		memcpy(&header, corpus + offset, sizeof(header));
+		size_t record_size = get_record_size(header);
+		if (corpus_size - offset < record_size) {
+			break;
+		}
+		entries.push_back({header.index, offset});
+		offset += record_size;
+	}
+
+	munmap((void *)corpus, corpus_size);
+
+	if (offset != corpus_size) {
+		throw std::runtime_error("corpus: " + corpus_filename +
+			" ends with a partial record");
+	}
+
+	// If a board is in there more than once, the last one wins.
+	std::stable_sort(entries.begin(), entries.end(),
+		[](const std::pair<uint64_t, uint64_t> & a,
+			const std::pair<uint64_t, uint64_t> & b) {
+			return a.first < b.first;
+		});
+	std::vector<uint64_t> pairs;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (i + 1 < entries.size() &&
+			entries[i].first == entries[i+1].first) {
+			continue;
+		}
+		pairs.push_back(entries[i].first);
+		pairs.push_back(entries[i].second);
+	}
+
+	// Write to a temporary file and then rename it, so that nobody
+	// reads a half-written index.
+	std::string index_filename = corpus_filename + ".index";
+	std::string temp_filename = index_filename + ".tmp";
+	uint64_t indexed_size = corpus_size;
+
+	std::ofstream out(temp_filename, std::ios::binary);
+	out.write(CORPUS_INDEX_MAGIC, sizeof(CORPUS_INDEX_MAGIC));
+	out.write((const char *)&indexed_size, sizeof(indexed_size));
+	out.write((const char *)pairs.data(), 8 * pairs.size());
+	out.close();
+
+	if (!out || rename(temp_filename.c_str(), index_filename.c_str()) != 0) {
+		throw std::runtime_error("corpus: could not write " +
+			index_filename);
+	}
+}
+
+// The index header is the magic and the size of the corpus it's for.
+static const size_t INDEX_HEADER_SIZE = sizeof(CORPUS_INDEX_MAGIC) + 8;
+
+static bool index_is_current(const std::string & corpus_filename) {
+	std::ifstream index(corpus_filename + ".index", std::ios::binary);
+	char magic[sizeof(CORPUS_INDEX_MAGIC)];
+	uint64_t indexed_size;
+
+	index.read(magic, sizeof(magic));
+	index.read((char *)&indexed_size, sizeof(indexed_size));
+
+	struct stat file_info;
+	return index && memcmp(magic, CORPUS_INDEX_MAGIC, sizeof(magic)) == 0 &&
+		stat(corpus_filename.c_str(), &file_info) == 0 &&
+		(uint64_t)file_info.st_size == indexed_size;
+}
+
+corpus_reader::corpus_reader(const std::string & corpus_filename) {
+	if (!index_is_current(corpus_filename)) {
+		write_corpus_index(corpus_filename);
+	}
+
+	corpus = map_file(corpus_filename, corpus_size);
+	index_mapping = map_file(corpus_filename + ".index",
+		index_mapping_size);
+
+	// The corpus may have been changed since we checked the index.
+	uint64_t indexed_size = corpus_size;
+	bool valid = corpus_size >= sizeof(CORPUS_MAGIC) &&
+		memcmp(corpus, CORPUS_MAGIC, sizeof(CORPUS_MAGIC)) == 0 &&
+		index_mapping_size >= INDEX_HEADER_SIZE &&
+		(index_mapping_size - INDEX_HEADER_SIZE) %
+			sizeof(index_entry) == 0 &&
+		memcmp(index_mapping + sizeof(CORPUS_INDEX_MAGIC), &indexed_size,
+			sizeof(indexed_size)) == 0;
+
+	if (!valid) {
+		unmap();
+		throw std::runtime_error("corpus: " + corpus_filename +
+			" doesn't match its index");
+	}
+
+	entries = (const index_entry *)(index_mapping + INDEX_HEADER_SIZE);
+	num_entries = (index_mapping_size - INDEX_HEADER_SIZE) /
+		sizeof(index_entry);
+}
+
+void corpus_reader::unmap() {
+	if (corpus) {
+		munmap((void *)corpus, corpus_size);
+	}
+	if (index_mapping) {
+		munmap((void *)index_mapping, index_mapping_size);
+	}
+	corpus = index_mapping = nullptr;
+}
+
+corpus_reader::~corpus_reader() {
+	unmap();
+}
+
+const corpus_reader::index_entry * corpus_reader::find(
+	uint64_t index) const {
+
+	const index_entry * found = std::lower_bound(entries,
+		entries + num_entries, index,
+		[](const index_entry & entry, uint64_t value) {
+			return entry.index < value;
+		});
+
+	if (found == entries + num_entries || found->index != index) {
+		return nullptr;
+	}
+	return found;
+}
+
+corpus_entry corpus_reader::decode(uint64_t offset) const {
+	// The index may be out of date if the corpus was changed since.
+	corpus_header header;
+	if (offset > corpus_size || corpus_size - offset < sizeof(header)) {
+		throw std::runtime_error("corpus: index points past the end");
+	}
+	memcpy(&header, corpus + offset, sizeof(header));
+	if (corpus_size - offset < get_record_size(header)) {
+		throw std::runtime_error("corpus: record at " +
+			std::to_string(offset) + " runs past the end");
+	}
+	const uint8_t * data = corpus + offset + sizeof(header);
+
+	corpus_entry entry;
+	entry.index = header.index;
+	entry.seed = header.seed;
+	entry.max_depth = header.max_depth;
+	entry.end_square = coord(header.end_x, header.end_y);
+	entry.result = eval_score(header.score, header.solution_length);
+
+	coord size(header.width, header.height);
+	entry.board = zzt_board(coord(header.player_x, header.player_y), size);
+
+	std::vector<uint64_t> board_words(entry.board.get_packed_size());
+	memcpy(board_words.data(), data, 8 * board_words.size());
+	entry.board.unpack(board_words.data());
+	data += 8 * board_words.size();
+
+	for (int i = 0; i < header.num_moves; ++i) {
+		uint64_t word;
+		memcpy(&word, data + 8 * (i / MOVES_PER_WORD), 8);
+		entry.solution.push_back((direction)((word >>
+			(2 * (i % MOVES_PER_WORD))) & 3));
+	}
+	data += 8 * ((header.num_moves + MOVES_PER_WORD - 1) / MOVES_PER_WORD);
+
+	entry.stats.resize(header.num_stats);
+	memcpy(entry.stats.data(), data, 8 * header.num_stats);
+
+	return entry;
+}
+
+corpus_entry corpus_reader::get(uint64_t index) const {
+	const index_entry * found = find(index);
+	if (!found) {
+		throw std::runtime_error("corpus: no board with index " +
+			std::to_string(index));
+	}
+	return decode(found->offset);
+}
+
+zzt_board load_or_grow_board(const corpus_reader * corpus, uint64_t index,
+	coord player_pos, coord end_square, coord size, int max_depth,
+	solver & guiding_solver) {
+
+	if (corpus && corpus->contains(index)) {
+		corpus_entry entry = corpus->get(index);
+		if (entry.board.get_size() == size &&
+			entry.board.player_pos == player_pos &&
+			entry.end_square == end_square &&
+			entry.max_depth == max_depth) {
+			return entry.board;
+		}
+	}
+	return grow_indexed_board(player_pos, end_square, size, max_depth,
+		guiding_solver, index);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "solver/solver.h"
+#include "board.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A compact on-disk format for generated puzzles, so that they can be
+// loaded again (e.g. by the writer, or for analysis) without growing
+// them all over again.
+
+// A corpus file is CORPUS_MAGIC followed by one record per puzzle:
+//	- a corpus_header,
+//	- the board, three bits per tile (see zzt_board::pack),
+//	- the solution, two bits per move, 32 moves to a word,
+//	- the statistics, as doubles.
+// Everything is in native byte order and aligned to eight bytes.
+// Records are self-delimiting, so a corpus can be appended to.
+
+// The index for a corpus is a separate file (the corpus filename plus
+// ".index"): CORPUS_INDEX_MAGIC, the size of the corpus it was made
+// for, and then (board index, offset) pairs sorted by board index. It
+// can be memory-mapped and searched as is.
+
+extern const char CORPUS_MAGIC[8];
+extern const char CORPUS_INDEX_MAGIC[8];
+
+struct corpus_header {
+	uint64_t index;
+	// What the generator's RNG was seeded with. That's the index
+	// itself, except for index 0, which is seeded from the entropy
+	// source and so can't be regenerated.
+	uint64_t seed;
+	uint8_t width, height;
+	uint8_t player_x, player_y;
+	uint8_t end_x, end_y;
+	// Depth that the board was grown to.
+	uint8_t max_depth;
+	uint8_t padding_a = 0;
+	int32_t score, solution_length;
+	uint16_t num_moves, num_stats;
+	uint32_t padding_b = 0;
+};
+
+struct corpus_entry {
+	uint64_t index = 0, seed = 0;
+	int max_depth = 0;
+	zzt_board board;
+	coord end_square;
+	eval_score result;
+	std::vector<direction> solution;
+	std::vector<double> stats;
+};
+
+// Returns the entry as a corpus record.
+std::string encode_corpus_entry(const corpus_entry & entry);
+
+// Writes the index for the given corpus.
+void write_corpus_index(const std::string & corpus_filename);
+
+class corpus_reader {
+	private:
+		const uint8_t * corpus = nullptr;
+		size_t corpus_size = 0;
+
+		const uint8_t * index_mapping = nullptr;
+		size_t index_mapping_size = 0;
+
+		struct index_entry {
+			uint64_t index, offset;
+		};
+
+		// Points into the index mapping, past the header.
+		const index_entry * entries = nullptr;
+		size_t num_entries = 0;
+
+		void unmap();
+		const index_entry * find(uint64_t index) const;
+		corpus_entry decode(uint64_t offset) const;
+
+	public:
+		// Maps the corpus and its index. If there's no index, or it's
+		// for an older version of the corpus, it's written first.
+		corpus_reader(const std::string & corpus_filename);
+		~corpus_reader();
+
+		corpus_reader(const corpus_reader &) = delete;
+		corpus_reader & operator=(const corpus_reader &) = delete;
+
+		size_t size() const { return num_entries; }
+
+		bool contains(uint64_t index) const {
+			return find(index) != nullptr;
+		}
+
+		// Returns the entry for the given board index, or throws if
+		// there is none.
+		corpus_entry get(uint64_t index) const;
+
+		// Returns the nth entry in board index order.
+		corpus_entry get_nth(size_t n) const {
+			return decode(entries[n].offset);
+		}
+};
+
+// Returns the board with the given index from the corpus if it has one
+// grown the same way (the same size, player and end squares, and
+// depth), or else grows it. corpus may be nullptr.
+zzt_board load_or_grow_board(const corpus_reader * corpus, uint64_t index,
+	coord player_pos, coord end_square, coord size, int max_depth,
+	solver & guiding_solver);
@@ -0,0 +1,366 @@
+#include "endgame.h"
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include <array>
+
+const char * DEFAULT_ENDGAME_FILE = "endgame_3x3.bin";
+const char * ENDGAME_FILE_VARIABLE = "ZZT_ENDGAME_FILE";
+
+// Identifies the file format. It's followed by ENDGAME_VERSION, and then
+// the bit array.
+static const char ENDGAME_MAGIC[8] = {'Z', 'Z', 'T', 'E', 'G', '3', 'x', '3'};
+
+// Change this whenever the table would come out differently: if the
+// tiles, the region, or the rules for moving in it (region_push) change.
+// Tables for other versions are rejected, and the default table is
+// generated again.
+static const uint64_t ENDGAME_VERSION = 2;
+
+static const size_t ENDGAME_HEADER_SIZE = sizeof(ENDGAME_MAGIC) +
+	sizeof(ENDGAME_VERSION);
+
+static const int DIM = endgame_table::REGION_DIM;
+
+// Region tiles, in the order used for the configuration number.
+// Position i in the region is (i % DIM, i / DIM), with the end square
+// at the bottom right.
+enum region_tile : uint8_t {R_EMPTY = 0, R_SOLID = 1, R_SLIDEREW = 2,
+	R_SLIDERNS = 3, R_BOULDER = 4};
+
+typedef std::array<uint8_t, endgame_table::REGION_TILES> region;
+
+static uint32_t get_config(const region & tiles) {
+	uint32_t config = 0;
+	for (int i = endgame_table::REGION_TILES-1; i >= 0; --i) {
+		config = config * endgame_table::TILE_KINDS + tiles[i];
+	}
+	return config;
+}
+
+static region get_region(uint32_t config) {
+	region tiles;
+	for (int i = 0; i < endgame_table::REGION_TILES; ++i) {
+		tiles[i] = config % endgame_table::TILE_KINDS;
+		config /= endgame_table::TILE_KINDS;
+	}
+	return tiles;
+}
+
+static bool region_pushable(uint8_t what, int dx, int dy) {
+	switch(what) {
+		case R_SLIDEREW: return dy == 0;
+		case R_SLIDERNS: return dx == 0;
+		case R_BOULDER: return true;
+		default: return false;
+	}
+}
+
+// Move the player onto (x, y), going in the direction (dx, dy) and pushing
+// whatever is in the way. Returns false if that's impossible. The east
+// and south sides of the region are the edge of the board; anything pushed
+// off the west or north side is gone.
+static bool region_push(region & tiles, int x, int y, int dx, int dy) {
+	int end_x = x, end_y = y;
+
+	while (end_x >= 0 && end_y >= 0 && end_x < DIM && end_y < DIM &&
+		tiles[end_y * DIM + end_x] != R_EMPTY) {
+
+		if (!region_pushable(tiles[end_y * DIM + end_x], dx, dy)) {
+			return false;
+		}
+		end_x += dx;
+		end_y += dy;
+	}
+
+	if (end_x >= DIM || end_y >= DIM) {
+		return false;
+	}
+
+	// Shift the chain one step along, starting from the far end.
+	while (end_x != x || end_y != y) {
+		if (end_x >= 0 && end_y >= 0) {
+			tiles[end_y * DIM + end_x] =
+				tiles[(end_y - dy) * DIM + end_x - dx];
+		}
+		end_x -= dx;
+		end_y -= dy;
+	}
+
+	tiles[y * DIM + x] = R_EMPTY;
+	return true;
+}
+
+// Get the states that can be reached in one move, and return how many
+// there are. A state is the configuration number times (REGION_TILES+1)
+// plus the player's position.
+static int get_successors(const region & tiles, int player,
+	std::array<uint64_t, 2*DIM> & out) {
+
+	int count = 0;
+	const int NUM_POSITIONS = endgame_table::REGION_TILES + 1;
+
+	// From outside, the player can enter the region from the west or
+	// north side at any point.
+	if (player == endgame_table::PLAYER_OUTSIDE) {
+		for (int i = 0; i < DIM; ++i) {
+			region east = tiles, south = tiles;
+			if (region_push(east, 0, i, 1, 0)) {
+				out[count++] = (uint64_t)get_config(east) * NUM_POSITIONS +
+					i * DIM;
+			}
+			if (region_push(south, i, 0, 0, 1)) {
+				out[count++] = (uint64_t)get_config(south) * NUM_POSITIONS + i;
+			}
+		}
+		return count;
+	}
+
+	int x = player % DIM, y = player / DIM;
+
+	for (direction dir: {NORTH, SOUTH, EAST, WEST}) {
+		coord delta = get_delta(dir);
+		int next_x = x + delta.x, next_y = y + delta.y;
+
+		if (next_x < 0 || next_y < 0) {
+			out[count++] = (uint64_t)get_config(tiles) * NUM_POSITIONS +
+				endgame_table::PLAYER_OUTSIDE;
+			continue;
+		}
+
+		region next = tiles;
+		if (region_push(next, next_x, next_y, delta.x, delta.y)) {
+			out[count++] = (uint64_t)get_config(next) * NUM_POSITIONS +
+				next_y * DIM + next_x;
+		}
+	}
+
+	return count;
+}
+
+void endgame_table::generate(const std::string & filename) {
+	const int NUM_POSITIONS = REGION_TILES + 1;
+
+	// Start with the boards where the player is on the end square, then
+	// mark every board that can get to a solvable one as solvable, until
+	// there are no more of them. The rest can't be solved.
+	std::vector<uint8_t> solvable(NUM_STATES, 0);
+
+	for (uint32_t config = 0; config < NUM_CONFIGS; ++config) {
+		if (get_region(config)[REGION_TILES-1] == R_EMPTY) {
+			solvable[(uint64_t)config * NUM_POSITIONS + REGION_TILES-1] = 1;
+		}
+	}
+
+	std::array<uint64_t, 2*DIM> successors;
+	bool changed = true;
+
+	while (changed) {
+		changed = false;
+
+		for (uint32_t config = 0; config < NUM_CONFIGS; ++config) {
+			region tiles = get_region(config);
+
+			for (int player = 0; player < NUM_POSITIONS; ++player) {
+				uint64_t state = (uint64_t)config * NUM_POSITIONS + player;
+				if (solvable[state]) { continue; }
+				if (player != PLAYER_OUTSIDE && tiles[player] != R_EMPTY) {
+					continue;
+				}
+
+				int count = get_successors(tiles, player, successors);
+				for (int i = 0; i < count && !solvable[state]; ++i) {
+					if (solvable[successors[i]]) {
+						solvable[state] = 1;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+
+	// Pack the refutations into bits. States where the player is on top
+	// of something don't exist, so they're never refuted.
+	std::vector<uint8_t> refuted_bits((NUM_STATES + 7) / 8, 0);
+
+	for (uint32_t config = 0; config < NUM_CONFIGS; ++config) {
+		region tiles = get_region(config);
+
+		for (int player = 0; player < NUM_POSITIONS; ++player) {
+			uint64_t state = (uint64_t)config * NUM_POSITIONS + player;
+			if (player != PLAYER_OUTSIDE && tiles[player] != R_EMPTY) {
+				continue;
+			}
+			if (!solvable[state]) {
+				refuted_bits[state / 8] |= 1 << (state % 8);
+			}
+		}
+	}
+
+	// Write to a temporary file and then rename it, so that nobody
+	// reads a half-written table. The temporary file is our own, so
+	// that processes generating the table at once don't get in each
+	// other's way; the last rename wins, and the tables are the same.
+	std::string temp_filename = filename + "." +
+		std::to_string(getpid()) + ".tmp";
+	std::ofstream out(temp_filename, std::ios::binary);
+	out.write(ENDGAME_MAGIC, sizeof(ENDGAME_MAGIC));
+	out.write((const char *)&ENDGAME_VERSION, sizeof(ENDGAME_VERSION));
+	out.write((const char *)refuted_bits.data(), refuted_bits.size());
+	out.close();
+
+	if (!out || rename(temp_filename.c_str(), filename.c_str()) != 0) {
+		remove(temp_filename.c_str());
+		throw std::runtime_error("endgame_table: could not write " +
+			filename);
+	}
+}
+
+bool endgame_table::is_current(const std::string & filename) {
+	std::ifstream in(filename, std::ios::binary | std::ios::ate);
+	if (!in || (size_t)in.tellg() != ENDGAME_HEADER_SIZE +
+		(NUM_STATES + 7) / 8) {
+		return false;
+	}
+
+	char magic[sizeof(ENDGAME_MAGIC)];
+	uint64_t version;
+	in.seekg(0);
+	in.read(magic, sizeof(magic));
+	in.read((char *)&version, sizeof(version));
+
+	return in && memcmp(magic, ENDGAME_MAGIC, sizeof(magic)) == 0 &&
+		version == ENDGAME_VERSION;
+}
+
+endgame_table::endgame_table(const std::string & filename) {
+	size_t expected_size = ENDGAME_HEADER_SIZE + (NUM_STATES + 7) / 8;
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("endgame_table: could not open " +
+			filename);
+	}
+
+	struct stat file_info;
+	if (fstat(fd, &file_info) != 0 ||
+		(size_t)file_info.st_size != expected_size) {
+		close(fd);
+		throw std::runtime_error("endgame_table: " + filename +
+			" has the wrong size");
+	}
+
+	void * mapped = mmap(nullptr, expected_size, PROT_READ, MAP_SHARED,
+		fd, 0);
+	close(fd);
+
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("endgame_table: could not map " +
+			filename);
+	}
+
+	mapping = (const uint8_t *)mapped;
+	mapping_size = expected_size;
+
+	if (memcmp(mapping, ENDGAME_MAGIC, sizeof(ENDGAME_MAGIC)) != 0) {
+		munmap((void *)mapping, mapping_size);
+		throw std::runtime_error("endgame_table: " + filename +
+			" is not an endgame table");
+	}
+
+	uint64_t version;
+	memcpy(&version, mapping + sizeof(ENDGAME_MAGIC), sizeof(version));
+	if (version != ENDGAME_VERSION) {
+		munmap((void *)mapping, mapping_size);
+		throw std::runtime_error("endgame_table: " + filename +
+			" is for a different version of the rules");
+	}
+
+	refuted_bits = mapping + ENDGAME_HEADER_SIZE;
+}
+
+endgame_table::~endgame_table() {
+	munmap((void *)mapping, mapping_size);
+}
+
+bool endgame_table::is_refuted(const zzt_board & board,
+	const coord & end_square) const {
+
+	coord size = board.get_size();
+
+	if (size.x < DIM || size.y < DIM) {
+		return false;
+	}
+
+	// Mirror the board so that the end square is at the bottom right.
+	// This doesn't change how sliders move.
+	int x_step, y_step;
+
+	if (end_square.x == size.x-1) {
+		x_step = 1;
+	} else if (end_square.x == 0) {
+		x_step = -1;
+	} else {
+		return false;
+	}
+
+	if (end_square.y == size.y-1) {
+		y_step = 1;
+	} else if (end_square.y == 0) {
+		y_step = -1;
+	} else {
+		return false;
+	}
+
+	uint64_t config = 0;
+	int player = PLAYER_OUTSIDE;
+
+	for (int i = REGION_TILES-1; i >= 0; --i) {
+		coord pos(end_square.x - x_step * (DIM - 1 - i % DIM),
+			end_square.y - y_step * (DIM - 1 - i / DIM));
+
+		int kind = R_EMPTY;
+		switch(board.get_tile_at(pos)) {
+			case T_EMPTY: break;
+			case T_PLAYER: player = i; break;
+			case T_SOLID: kind = R_SOLID; break;
+			case T_SLIDEREW: kind = R_SLIDEREW; break;
+			case T_SLIDERNS: kind = R_SLIDERNS; break;
+			case T_BOULDER: kind = R_BOULDER; break;
+		}
+		config = config * TILE_KINDS + kind;
+	}
+
+	uint64_t state = config * (REGION_TILES + 1) + player;
+	return refuted_bits[state / 8] & (1 << (state % 8));
+}
+
+// Only called once, when the default table is first needed.
+static std::string prepare_default_file() {
+	std::string filename = DEFAULT_ENDGAME_FILE;
+	const char * from_environment = getenv(ENDGAME_FILE_VARIABLE);
+	if (from_environment && *from_environment) {
+		filename = from_environment;
+	}
+
+	if (!endgame_table::is_current(filename)) {
+		std::cerr << "Generating endgame table " << filename
+			<< "..." << std::endl;
+		endgame_table::generate(filename);
+	}
+	return filename;
+}
+
+const endgame_table & endgame_table::get_default() {
+	static endgame_table default_table(prepare_default_file());
+	return default_table;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "board.h"
+
+#include <stdint.h>
+#include <string>
+
+// An endgame tablebase for the 3x3 region in the corner of the board
+// where the end square is. It tells us whether the player can get to the
+// end square at all, given what's in the region and where the player is.
+
+// Everything outside the region is assumed to be empty, and whatever gets
+// pushed out of the region disappears. Like the reduced board grow_board
+// used to use, this relies on removing pushables never making a puzzle
+// harder, so the relaxed puzzle is at least as easy as the real one: if
+// the tablebase says it's unsolvable, then so is the real board.
+
+// The table is computed by retrograde analysis (iterating backwards from
+// the boards with the player on the end square until nothing changes)
+// and stored as a bit array file that's memory-mapped for lookups.
+
+class endgame_table {
+	private:
+		const uint8_t * mapping = nullptr;
+		size_t mapping_size = 0;
+
+		// Points into the mapping, past the header. One bit per
+		// (region contents, player position) state: set if the player
+		// can't get to the end square from there.
+		const uint8_t * refuted_bits = nullptr;
+
+	public:
+		// Each region tile is empty, solid, an EW or NS slider, or a
+		// boulder, so there are 5^9 configurations, and the player can
+		// be on any of the nine squares or outside the region.
+		static const int REGION_DIM = 3;
+		static const int REGION_TILES = REGION_DIM * REGION_DIM;
+		static const int TILE_KINDS = 5;
+		static const int PLAYER_OUTSIDE = REGION_TILES;
+		static const int NUM_CONFIGS = 1953125;
+		static const uint64_t NUM_STATES =
+			(uint64_t)NUM_CONFIGS * (REGION_TILES + 1);
+
+		// Computes the table and writes it to the given file.
+		static void generate(const std::string & filename);
+
+		// Returns true if the file holds a table made by this version
+		// of the program.
+		static bool is_current(const std::string & filename);
+
+		// Maps the table in the given file.
+		endgame_table(const std::string & filename);
+		~endgame_table();
+
+		endgame_table(const endgame_table &) = delete;
+		endgame_table & operator=(const endgame_table &) = delete;
+
+		// Returns true if the board is unsolvable because of what's
+		// around the end square. False means we don't know, and is also
+		// what we say if the end square isn't in a corner, or the board
+		// is smaller than the region.
+		bool is_refuted(const zzt_board & board,
+			const coord & end_square) const;
+
+		// Returns the table in the file named by the environment
+		// variable ENDGAME_FILE_VARIABLE, or if it's not set, in
+		// DEFAULT_ENDGAME_FILE in the current directory. The table is
+		// generated first (which takes a few seconds) if the file
+		// doesn't exist or is for another version. This is thread-safe.
+		static const endgame_table & get_default();
+};
+
+extern const char * DEFAULT_ENDGAME_FILE;
+extern const char * ENDGAME_FILE_VARIABLE;
@@ -6,6 +6,7 @@
 
 import numpy as np
 import itertools
+import struct
 
 def read_puzzle_metadata(puzzle_file, puzzle_data={}):
 
@@ -24,6 +25,34 @@ def read_puzzle_metadata(puzzle_file, puzzle_data={}):
 
 	return puzzle_data
 
+# The same, but from a binary corpus written by zzt-puzzle --corpus
+# (see corpus.h). Unsolved boards have no statistics, so they're skipped.
+def read_corpus_metadata(corpus_filename, puzzle_data={}):
+
+	data = open(corpus_filename, "rb").read()
+	if data[:8] != b"ZZTCORP1":
+		raise ValueError("%s is not a corpus" % corpus_filename)
+
+	header = struct.Struct("=QQ8BiiHHI")
+	offset = 8
+
+	while offset < len(data):
+		(index, seed, width, height, player_x, player_y, end_x, end_y,
+			max_depth, padding_a, score, solution_length, num_moves,
+			num_stats, padding_b) = header.unpack_from(data, offset)
+
+		board_words = (width * height + 20) // 21
+		move_words = (num_moves + 31) // 32
+		stats_offset = offset + header.size + 8 * (board_words + move_words)
+
+		if num_stats > 0:
+			puzzle_data["N%d" % index] = list(struct.unpack_from(
+				"=%dd" % num_stats, data, stats_offset))
+
+		offset = stats_offset + 8 * num_stats
+
+	return puzzle_data
+
 # Return the row indices of the k rows in the haystack with
 # the best Euclidean distance to the needle.
 def k_best_euclidean(haystack, needle, k):
@@ -1,7 +1,9 @@
 #include "generator.h"
+#include "endgame.h"
 
-#include <random>
+#include <stdexcept>
 #include <algorithm>
+#include <random>
 #include <omp.h>
 
 typedef std::pair<coord, tile> coord_and_tile;
@@ -126,19 +128,111 @@ zzt_board create_indexed_puzzle(double sparsity,
 		player_pos, max_size, prng);
 }
 
+// Cheap checks for unsolvability, used by add_tile_if_solvable before
+// searching. Solids never move, so if the player can't get to the end
+// square even with every pushable gone, or if whatever is on the end
+// square can't be pushed off it because of solids, the board can't be
+// solved.
+
+// Returns true if the tile on the end square, if any, can never be
+// moved: every direction it can be pushed in has a solid (or the edge
+// of the board) on one side of it or the other.
+static bool stuck_on_end_square(const zzt_board & board,
+	const coord & end_square) {
+
+	tile at_end = board.get_tile_at(end_square);
+
+	if (at_end == T_EMPTY || at_end == T_PLAYER) {
+		return false;
+	}
+
+	for (direction dir: {NORTH, SOUTH, EAST, WEST}) {
+		coord delta = get_delta(dir);
+
+		if (at_end == T_SOLID ||
+			(at_end == T_SLIDEREW && delta.y != 0) ||
+			(at_end == T_SLIDERNS && delta.x != 0)) {
+			continue;
+		}
+
+		if (board.get_tile_at(end_square - delta) != T_SOLID &&
+			board.get_tile_at(end_square + delta) != T_SOLID) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Returns true if there's a path from the player to the end square
+// that doesn't go through any solids.
+static bool end_square_reachable(const zzt_board & board,
+	const coord & end_square) {
+
+	coord size = board.get_size();
+	std::vector<bool> seen(size.x * size.y, false);
+	std::vector<coord> to_visit = {board.player_pos};
+	seen[board.player_pos.y * size.x + board.player_pos.x] = true;
+
+	while (!to_visit.empty()) {
+		coord pos = to_visit.back();
+		to_visit.pop_back();
+
+		if (pos == end_square) {
+			return true;
+		}
+
+		for (direction dir: {NORTH, SOUTH, EAST, WEST}) {
+			coord next = pos + get_delta(dir);
+			if (board.get_tile_at(next) == T_SOLID ||
+				seen[next.y * size.x + next.x]) {
+				continue;
+			}
+			seen[next.y * size.x + next.x] = true;
+			to_visit.push_back(next);
+		}
+	}
+
+	return false;
+}
+
+// Returns true if following the solution takes the player to the end
+// square.
+static bool solves_board(zzt_board board, const coord & end_square,
+	const std::vector<direction> & solution) {
+
+	for (direction dir: solution) {
+		if (!board.do_move(dir)) {
+			return false;
+		}
+		if (board.player_pos == end_square) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 // This function adds the given tile to the board and checks
 // if the board is solvable. If not, the tile is removed and
 // the function returns -1. Otherwise, the function returns the
 // depth of the search required to solve the puzzle.
 
-// Parameters: board is the actual board, reduced_board is a
-// board that's only populated near the exit square (used to)
-// quickly detect some unsolvable situations.
+// solution is a solution to the board before the tile was added (or
+// empty if we don't have one), and is updated to one for the board
+// after. Most tiles don't get in its way, and then the board can still
+// be solved at the current depth. The search below starts at the
+// current depth, so it would also have returned the current depth once
+// there's a solution that long; we just skip it. Otherwise, we search.
+
+// Before searching, we try the checks above and the endgame
+// tablebase, which quickly detect some unsolvable boards. stats
+// records which of them (if any) rejected the tile.
 int add_tile_if_solvable(zzt_board & board,
-	zzt_board & reduced_board,
 	const coord_and_tile & new_coord_tile, coord player_pos,
 	coord end_square, solver & guiding_solver,
-	int current_depth, int max_depth) {
+	const endgame_table & endgame, int current_depth, int max_depth,
+	std::vector<direction> & solution, relaxation_stats & stats) {
 
 	// Don't overwrite the player position.
 	if (new_coord_tile.first == player_pos) {
@@ -146,13 +240,29 @@ int add_tile_if_solvable(zzt_board & board,
 	}
 
 	board.set(new_coord_tile.first, new_coord_tile.second);
+	++stats.tiles_tried;
+
+	if ((int)solution.size() <= current_depth &&
+		solves_board(board, end_square, solution)) {
+		++stats.solution_reuses;
+		return current_depth;
+	}
+
+	bool refuted = true;
 
-	// We always admit solids because they can only reduce
-	// the state space.
-	if (new_coord_tile.first.manhattan_dist(
-		end_square) < 6 || new_coord_tile.second == T_SOLID) {
-		reduced_board.set(new_coord_tile.first,
-			new_coord_tile.second);
+	if (stuck_on_end_square(board, end_square)) {
+		++stats.stuck_on_end;
+	} else if (!end_square_reachable(board, end_square)) {
+		++stats.unreachable;
+	} else if (endgame.is_refuted(board, end_square)) {
+		++stats.endgame;
+	} else {
+		refuted = false;
+	}
+
+	if (refuted) {
+		board.set(new_coord_tile.first, T_EMPTY);
+		return -1;
 	}
 
 	uint64_t nodes_visited = 0;
@@ -168,29 +278,22 @@ int add_tile_if_solvable(zzt_board & board,
 			std::cout << "grow_board/IDDFS: " << current_depth
 				<< "  \r" << std::flush;
 		}
-		// First test the reduced board.
-		result = guiding_solver.solve(reduced_board, end_square,
+		result = guiding_solver.solve(board, end_square,
 			current_depth, nodes_visited);
-		if (result.score > 0) {
-			result = guiding_solver.solve(board, end_square,
-				current_depth, nodes_visited);
-		}
 		if (result.score <= 0) {
 			++current_depth;
 		}
 	} while (result.score <= 0 && result.score != LOSS &&
 		current_depth < max_depth);
 
+	stats.search_nodes += nodes_visited;
+
 	if (result.score < 0) {
+		++stats.search_refutations;
 		board.set(new_coord_tile.first, T_EMPTY);
-		if (new_coord_tile.first.manhattan_dist(
-			end_square) < 6 || new_coord_tile.second == T_SOLID) {
-			reduced_board.set(new_coord_tile.first,
-				T_EMPTY);
-		}
-
 		return -1;
 	} else {
+		solution = guiding_solver.get_solution();
 		return current_depth;
 	}
 }
@@ -202,8 +305,10 @@ int add_tile_if_solvable(zzt_board & board,
 // giving up. A higher number of skips will give a higher chance
 // of a complex board, but generation will be slower.
 zzt_board grow_board(coord player_pos, coord end_square,
-	coord size, int recursion_level, solver & guiding_solver,
-	rng & rng_to_use, int min_skips, int max_skips) {
+	coord size, int recursion_level,
+	const std::vector<solver *> & guiding_solvers,
+	rng & rng_to_use, int min_skips, int max_skips,
+	relaxation_stats * stats) {
 
 	// One of the biggest wastes of time in this calculation
 	// is to determine if a board is solvable, because we need
@@ -211,13 +316,21 @@ zzt_board grow_board(coord player_pos, coord end_square,
 	// and there's no way to tell something is unsolvable short
 	// of trying everythin.
 
-	// Therefore, we use a reduced board where everything but
-	// the immediate environment around the exit is empty. If
-	// the reduced board (which has a considerably smaller
-	// state space) is unsolvable, then so is the full board.
+	// Therefore, we use an endgame tablebase of the immediate
+	// environment around the exit (see endgame.h) to reject
+	// tiles that make the board unsolvable without searching.
+
+	if (guiding_solvers.empty()) {
+		throw std::logic_error("grow_board: no solvers given");
+	}
 
 	zzt_board board(player_pos, size);
-	zzt_board reduced_board(player_pos, size);
+	const endgame_table & endgame = endgame_table::get_default();
+
+	relaxation_stats unused_stats;
+	if (!stats) {
+		stats = &unused_stats;
+	}
 
 	int sumlength = size.x + size.y;
 
@@ -231,6 +344,8 @@ zzt_board grow_board(coord player_pos, coord end_square,
 
 	int current_depth = 1;
 	int filled_squares = 0;
+	// A solution to the board so far, if we have one.
+	std::vector<direction> solution;
 
 	// For statistical purposes: this gives the longest stretch of
 	// apparently unsolvable puzzles before a deeper depth uncovers
@@ -240,45 +355,96 @@ zzt_board grow_board(coord player_pos, coord end_square,
 	// unsolvable.
 	int max_depth_until_solvable = 0;
 
-	for (auto new_coord_tile: empty_coord_assignments) {
+	// With more than one solver, we speculatively try the next tiles
+	// all at once, each on its own copy of the board.
+	size_t next_tile = 0;
+
+	while (next_tile < empty_coord_assignments.size()) {
+		size_t batch_size = std::min(guiding_solvers.size(),
+			empty_coord_assignments.size() - next_tile);
+
 		// Try a maxlength heuristic... seems to work in practice,
 		// that if we add something to a board, it'll never take more
 		// moves than the max length along an edge to solve... IDK why.
-		int solvable_at = add_tile_if_solvable(board,
-			reduced_board, new_coord_tile, player_pos, end_square,
-			guiding_solver, current_depth,
-			std::min(recursion_level, current_depth + sumlength+1));
-
-		// If it's unsolvable, either skip to the next one
-		// if we have more skips available, or give up.
-
-		if (solvable_at == -1) {
-			// Provide more information if we're not in parallel mode.
-			if (!omp_in_parallel()) {
-				std::cout << "\ngrow_board: unsolvable at " << filled_squares
-					<< "\n";
-			}
-			if (skips_remaining-- == 0) {
-				return board;
+		int max_depth = std::min(recursion_level,
+			current_depth + sumlength+1);
+
+		std::vector<zzt_board> boards(batch_size, board);
+		std::vector<int> solvable_at(batch_size);
+		std::vector<std::vector<direction> > solutions(batch_size,
+			solution);
+		std::vector<relaxation_stats> batch_stats(batch_size);
+
+		#pragma omp parallel for if(batch_size > 1) num_threads(batch_size) schedule(static, 1)
+		for (size_t i = 0; i < batch_size; ++i) {
+			solvable_at[i] = add_tile_if_solvable(boards[i],
+				empty_coord_assignments[next_tile + i], player_pos,
+				end_square, *guiding_solvers[i], endgame, current_depth,
+				max_depth, solutions[i], batch_stats[i]);
+		}
+
+		// Every tile up to the first one that fits was tried on the
+		// board we'd have tried it on if we went one at a time, so
+		// we go through those in order. The rest were tried on the
+		// wrong board, so we throw them away and try them again.
+		for (size_t i = 0; i < batch_size; ++i) {
+			++next_tile;
+			*stats += batch_stats[i];
+
+			// If it's unsolvable, either skip to the next one
+			// if we have more skips available, or give up.
+
+			if (solvable_at[i] == -1) {
+				// Provide more information if we're not in parallel mode.
+				if (!omp_in_parallel()) {
+					std::cout << "\ngrow_board: unsolvable at "
+						<< filled_squares << "\n";
+				}
+				if (skips_remaining-- == 0) {
+					return board;
+				}
+			} else {
+				// Update max depth until solvable stat.
+				max_depth_until_solvable = std::max(
+					max_depth_until_solvable, solvable_at[i] - current_depth);
+				current_depth = solvable_at[i];
+				board = boards[i];
+				solution = solutions[i];
+				++filled_squares;
+				break;
 			}
-		} else {
-			// Update max depth until solvable stat.
-			max_depth_until_solvable = std::max(max_depth_until_solvable,
-				solvable_at - current_depth);
-			current_depth = solvable_at;
-			++filled_squares;
 		}
 	}
 
 	return board;
 }
 
+zzt_board grow_board(coord player_pos, coord end_square,
+	coord size, int recursion_level, solver & guiding_solver,
+	rng & rng_to_use, int min_skips, int max_skips,
+	relaxation_stats * stats) {
+
+	return grow_board(player_pos, end_square, size, recursion_level,
+		std::vector<solver *>{&guiding_solver}, rng_to_use, min_skips,
+		max_skips, stats);
+}
+
 zzt_board grow_indexed_board(coord player_pos, coord end_square,
 	coord size, int recursion_level, solver & guiding_solver,
-	uint64_t index) {
+	uint64_t index, relaxation_stats * stats) {
+
+	return grow_indexed_board(player_pos, end_square, size,
+		recursion_level, std::vector<solver *>{&guiding_solver}, index,
+		stats);
+}
+
+zzt_board grow_indexed_board(coord player_pos, coord end_square,
+	coord size, int recursion_level,
+	const std::vector<solver *> & guiding_solvers, uint64_t index,
+	relaxation_stats * stats) {
 
 	rng prng(index);
 
 	return grow_board(player_pos, end_square, size,
-		recursion_level, guiding_solver, prng, 0, 5);
+		recursion_level, guiding_solvers, prng, 0, 5, stats);
 }
@@ -21,10 +21,66 @@ zzt_board create_indexed_puzzle(double sparsity,
 	coord player_pos, coord max_size,
 	uint64_t index);
 
+// Before searching to see if a new tile makes the board unsolvable,
+// grow_board tries some cheap checks on relaxed versions of the board:
+// if one of those can't be solved, then neither can the real board.
+// This counts how often each check settled the question, and how much
+// searching was needed for the rest.
+struct relaxation_stats {
+	uint64_t tiles_tried = 0;
+
+	// Something on the end square can never be pushed off it.
+	uint64_t stuck_on_end = 0;
+	// The player can't get to the end square even if every
+	// pushable is removed.
+	uint64_t unreachable = 0;
+	// Refuted by the endgame tablebase.
+	uint64_t endgame = 0;
+	// Tiles rejected by searching the real board, and the number of
+	// nodes visited by all the searches.
+	uint64_t search_refutations = 0;
+	uint64_t search_nodes = 0;
+
+	// Tiles accepted without searching, because the last solution
+	// still worked with them.
+	uint64_t solution_reuses = 0;
+
+	relaxation_stats & operator+=(const relaxation_stats & other) {
+		tiles_tried += other.tiles_tried;
+		stuck_on_end += other.stuck_on_end;
+		unreachable += other.unreachable;
+		endgame += other.endgame;
+		search_refutations += other.search_refutations;
+		search_nodes += other.search_nodes;
+		solution_reuses += other.solution_reuses;
+		return *this;
+	}
+};
+
 zzt_board grow_board(coord player_pos, coord end_square,
 	coord size, int recursion_level, solver & guiding_solver,
-	rng & rng_to_use, int min_skips, int max_skips);
+	rng & rng_to_use, int min_skips, int max_skips,
+	relaxation_stats * stats = nullptr);
 
 zzt_board grow_indexed_board(coord player_pos, coord end_square,
 	coord size, int recursion_level, solver & guiding_solver,
-	uint64_t index);
\ No newline at end of file
+	uint64_t index, relaxation_stats * stats = nullptr);
+
+// Speculative versions of the above: with n solvers, these try the next
+// n tiles at once (in parallel if OpenMP lets us), each with its own
+// solver, and keep the first that fits. The result is the same board
+// as with one solver; it just gets there sooner if many tiles are
+// rejected, as they are when the board is nearly full. The stats are
+// only for the tiles that were kept or rejected, not the ones thrown
+// away; but the number of search nodes depends on the solvers' state,
+// and so may differ anyway.
+zzt_board grow_board(coord player_pos, coord end_square,
+	coord size, int recursion_level,
+	const std::vector<solver *> & guiding_solvers,
+	rng & rng_to_use, int min_skips, int max_skips,
+	relaxation_stats * stats = nullptr);
+
+zzt_board grow_indexed_board(coord player_pos, coord end_square,
+	coord size, int recursion_level,
+	const std::vector<solver *> & guiding_solvers, uint64_t index,
+	relaxation_stats * stats = nullptr);
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// A queue that any number of threads can push to, without locking,
+// while a single thread pops from it. This is Vyukov's MPSC queue: a
+// linked list where producers swap themselves in at the head, and the
+// consumer follows the next pointers from the tail.
+
+// Pushing never waits. A producer that's been interrupted between
+// swapping in its node and linking it up hides what comes after it
+// until it gets going again, so pop() can return false even though
+// the queue isn't empty; the consumer just has to try again later.
+
+// T must be default constructible, because the list always has a dummy
+// node at the tail.
+
+template<typename T> class mpsc_queue {
+	private:
+		struct node {
+			std::atomic<node *> next;
+			T value;
+
+			node() : next(nullptr) {}
+			node(T && value_in) : next(nullptr),
+				value(std::move(value_in)) {}
+		};
+
+		// Producers push here. The consumer owns the tail: the node
+		// there is the dummy whose value has already been popped.
+		std::atomic<node *> head;
+		node * tail;
+
+	public:
+		mpsc_queue() {
+			tail = new node();
+			head.store(tail, std::memory_order_relaxed);
+		}
+
+		~mpsc_queue() {
+			while (tail) {
+				node * next = tail->next.load(std::memory_order_relaxed);
+				delete tail;
+				tail = next;
+			}
+		}
+
+		mpsc_queue(const mpsc_queue &) = delete;
+		mpsc_queue & operator=(const mpsc_queue &) = delete;
+
+		// Can be called by any thread.
+		void push(T value) {
+			node * new_node = new node(std::move(value));
+			node * previous = head.exchange(new_node,
+				std::memory_order_acq_rel);
+			previous->next.store(new_node, std::memory_order_release);
+		}
+
+		// Must only be called by the consumer. Returns false if
+		// there's nothing (visible) to pop.
+		bool pop(T & out) {
+			node * next = tail->next.load(std::memory_order_acquire);
+			if (!next) {
+				return false;
+			}
+			out = std::move(next->value);
+			delete tail;
+			tail = next;
+			return true;
+		}
+};
@@ -1,12 +1,21 @@
 #include <unordered_map>
+#include <filesystem>
 #include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <iterator>
+#include <fstream>
+#include <sstream>
 #include <cstddef>
+#include <cstdlib>
 #include <numeric>
 #include <limits>
+#include <memory>
 #include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <unistd.h>
 #include <cmath>
 #include <list>
 #include <map>
@@ -15,6 +24,10 @@
 #include "coord.h"
 #include "board.h"
 #include "generator.h"
+#include "endgame.h"
+#include "mpsc_queue.h"
+#include "corpus.h"
+#include "batch.h"
 
 #include "solver/all.h"
 
@@ -117,8 +130,8 @@ int get_path_turns(const std::vector<direction> & solution) {
 	return turns_so_far;
 }
 
-// Calculate how much a move changes a board.
-int count_changes(zzt_board before, zzt_board after) {
+// Count the tiles that differ between two boards.
+int count_changes(const zzt_board & before, const zzt_board & after) {
 
 	coord where;
 	int changes = 0;
@@ -134,45 +147,6 @@ int count_changes(zzt_board before, zzt_board after) {
 	return changes;
 }
 
-// Count changes along as the player moves on a path.
-// The board is really const because we'll undo every move we do,
-// but C++ doesn't know that.
-std::vector<int> count_changes(zzt_board board,
-	const std::vector<direction> & path) {
-
-	std::vector<int> changes;
-
-	for (direction d: path) {
-		zzt_board before = board;
-		if (!board.do_move(d)) {
-			throw std::runtime_error("count_changes: Can't make that move!");
-		}
-		changes.push_back(count_changes(before, board));
-	}
-
-	for (size_t i = 0; i < path.size(); ++i) {
-		board.undo_move();
-	}
-
-	return changes;
-}
-
-// Count the number of changes between the starting and the
-// end position.
-int count_start_end_changes(zzt_board board,
-	const std::vector<direction> & path) {
-
-	zzt_board before = board;
-
-	for (direction d: path) {
-		if (!board.do_move(d)) {
-			throw std::runtime_error("count_changes: Can't make that move!");
-		}
-	}
-
-	return count_changes(before, board);
-}
-
 // Get the fraction of tiles that are not empty.
 double get_density(const zzt_board & board) {
 	coord where;
@@ -332,6 +306,27 @@ bool verify_solution(zzt_board board, const coord end_square,
 	return board.player_pos == end_square;
 }
 
+// Check that what replay says each move of the path changed agrees
+// with comparing the board before and after it.
+void test_move_effects(const zzt_board & start,
+	const std::vector<direction> & path) {
+
+	zzt_board replayed = start;
+	std::vector<move_effect> effects = replayed.replay(path);
+
+	zzt_board board = start;
+	for (size_t i = 0; i < path.size(); ++i) {
+		zzt_board before = board;
+		if (!board.do_move(path[i])) {
+			throw std::logic_error("Move effects: Can't make that move!");
+		}
+		if (effects[i].tiles_changed != count_changes(before, board)) {
+			throw std::logic_error("Move effects: replay counted the "
+				"wrong number of changed tiles");
+		}
+	}
+}
+
 // Test that the DFS works by using a test case that currently
 // produces way too long a solution, where a shorter one would
 // suffice.
@@ -356,6 +351,7 @@ void test_dfs_solver_once(coord board_size, std::string specification,
 	} else {
 		throw std::logic_error("Manual solution is not OK");
 	}
+	test_move_effects(test_board, manual_solution);
 
 	if (result.score < 0) {
 		throw std::logic_error("DFS: Couldn't find solution!");
@@ -369,6 +365,7 @@ void test_dfs_solver_once(coord board_size, std::string specification,
 	if (!verify_solution(test_board, end_square, dfs_solution)) {
 		throw std::logic_error("DFS solution is invalid!");
 	}
+	test_move_effects(test_board, dfs_solution);
 
 	if ((int)dfs_solution.size() != result.solution_length) {
 		throw std::logic_error("DFS: reported solution length is not "
@@ -379,6 +376,35 @@ void test_dfs_solver_once(coord board_size, std::string specification,
 		throw std::logic_error("DFS 'shortest' solution is "
 			"longer than manual solution!");
 	}
+
+	// The parallel solver should find a solution of the same length.
+	parallel_dfs_solver parallel_dfs;
+	eval_score parallel_result = parallel_dfs.solve(test_board,
+		end_square, manual_solution.size()+5, nodes_visited);
+	std::vector<direction> parallel_solution = parallel_dfs.get_solution();
+
+	std::cout << "Parallel DFS:    ";
+	print_solution(parallel_solution);
+
+	if (parallel_result != result ||
+		!verify_solution(test_board, end_square, parallel_solution) ||
+		(int)parallel_solution.size() != parallel_result.solution_length) {
+		throw std::logic_error("Parallel DFS solution differs from DFS!");
+	}
+
+	astar_solver astar;
+	eval_score astar_result = astar.solve(test_board,
+		end_square, manual_solution.size()+5, nodes_visited);
+	std::vector<direction> astar_solution = astar.get_solution();
+
+	std::cout << "A*:              ";
+	print_solution(astar_solution);
+
+	if (astar_result.score != WIN ||
+		!verify_solution(test_board, end_square, astar_solution) ||
+		astar_solution.size() > manual_solution.size()) {
+		throw std::logic_error("A* solution is invalid!");
+	}
 }
 
 void find_error_board(coord max, int min_depth, int max_depth) {
@@ -419,8 +445,136 @@ void find_error_board(coord max, int min_depth, int max_depth) {
 }
 
 
-// TODO? Very short unsolvable puzzle to make sure it returns LOSS
-// when it knows there's no solution at all.
+// Check that the DFS returns LOSS, and that IDDFS stops right away,
+// when it has searched everything there is to search. If the board
+// needs_search, it must take more than the root to do so, i.e. the
+// quick checks in the DFS mustn't see that it's unsolvable.
+
+void test_dfs_refutation_once(coord board_size, std::string specification,
+	coord end_square, bool needs_search = false) {
+	zzt_board test_board = board_from_str(board_size,
+		specification);
+
+	std::cout << "Testing unsolvable board:\n";
+	test_board.print();
+
+	const int max_depth = 45;
+
+	dfs_solver dfs;
+	uint64_t nodes_visited = 0;
+	eval_score result = dfs.solve(test_board, end_square, max_depth,
+		nodes_visited);
+
+	if (result.score != LOSS || dfs.get_horizon_cuts() != 0) {
+		throw std::logic_error("DFS: Couldn't prove board unsolvable!");
+	}
+	if (needs_search && nodes_visited <= 1) {
+		throw std::logic_error("DFS: Refuted a board that should need "
+			"searching at the root");
+	}
+
+	iddfs_solver<dfs_solver> iddfs, deeper_iddfs;
+	uint64_t iddfs_nodes = 0, deeper_nodes = 0;
+	result = iddfs.solve(test_board, end_square, max_depth, iddfs_nodes);
+	eval_score deeper_result = deeper_iddfs.solve(test_board, end_square,
+		2 * max_depth, deeper_nodes);
+
+	// Every iteration visits at least the root, so if it didn't stop,
+	// letting it go deeper would've made it visit more nodes.
+	if (result.score != LOSS || deeper_result.score != LOSS ||
+		deeper_nodes != iddfs_nodes) {
+		throw std::logic_error("IDDFS: Didn't stop on unsolvable board!");
+	}
+
+	std::cout << "Refuted with " << nodes_visited << " nodes (DFS), "
+		<< iddfs_nodes << " nodes (IDDFS)" << std::endl;
+}
+
+// Test that entries written to a corpus come back the same through its
+// index, and that load_or_grow_board only grows what the corpus lacks.
+void test_corpus() {
+	std::string filename = (std::filesystem::temp_directory_path() /
+		("zzt-corpus-test." + std::to_string(getpid()))).string();
+
+	// Index 3 is in there twice, so the second one should win. The
+	// solutions are long enough to need more than one word.
+	std::vector<uint64_t> indices = {5, 3, 8, 3};
+	std::map<uint64_t, corpus_entry> expected;
+
+	std::ofstream out(filename, std::ios::binary);
+	out.write(CORPUS_MAGIC, sizeof(CORPUS_MAGIC));
+
+	for (size_t i = 0; i < indices.size(); ++i) {
+		corpus_entry entry;
+		entry.index = indices[i];
+		entry.seed = indices[i];
+		entry.max_depth = 30 + i;
+
+		coord size(4 + entry.index % 4, 4 + (entry.index/4) % 4);
+		entry.board = zzt_board(coord(0, 3), size);
+		rng prng(i + 1);
+		fill_puzzle(entry.board, size.x * size.y / 2, prng);
+		entry.end_square = coord(size.x-1, size.y-1);
+
+		entry.result = eval_score(WIN, 33 + i);
+		for (size_t j = 0; j < 33 + i; ++j) {
+			entry.solution.push_back((direction)(prng.irand() % 4));
+		}
+		entry.stats = {(double)i, 0.1, -2.5};
+
+		out << encode_corpus_entry(entry);
+		expected[entry.index] = entry;
+	}
+	out.close();
+
+	write_corpus_index(filename);
+
+	{
+		corpus_reader corpus(filename);
+		if (corpus.size() != expected.size()) {
+			throw std::logic_error("Corpus: wrong number of entries");
+		}
+
+		for (auto & [index, entry]: expected) {
+			corpus_entry read = corpus.get(index);
+			if (read.index != index || read.seed != entry.seed ||
+				read.max_depth != entry.max_depth ||
+				!(read.board == entry.board) ||
+				read.board.player_pos != entry.board.player_pos ||
+				read.end_square != entry.end_square ||
+				read.result != entry.result ||
+				read.solution != entry.solution ||
+				read.stats != entry.stats) {
+				throw std::logic_error("Corpus: entry " +
+					std::to_string(index) + " didn't come back the same");
+			}
+		}
+
+		// A board from the corpus; the same board asked for at
+		// another depth, which has to be grown again; and one that
+		// isn't in the corpus.
+		dfs_solver dfs;
+		coord size(4, 6), player_pos(0, 3), end_square(3, 5);
+		zzt_board loaded = load_or_grow_board(&corpus, 8, player_pos,
+			end_square, size, expected[8].max_depth, dfs);
+		zzt_board regrown = load_or_grow_board(&corpus, 8, player_pos,
+			end_square, size, 10, dfs);
+		zzt_board grown = load_or_grow_board(&corpus, 4, player_pos,
+			end_square, size, 10, dfs);
+		if (!(loaded == expected[8].board) || !(regrown ==
+			grow_indexed_board(player_pos, end_square, size, 10, dfs, 8)) ||
+			!(grown == grow_indexed_board(player_pos, end_square, size,
+				10, dfs, 4))) {
+			throw std::logic_error("Corpus: load_or_grow_board got the "
+				"wrong board");
+		}
+	}
+
+	std::filesystem::remove(filename);
+	std::filesystem::remove(filename + ".index");
+
+	std::cout << "Corpus is OK" << std::endl;
+}
 
 void test_dfs() {
 	// Specially constructed board to test the "no return" heuristic
@@ -461,6 +615,40 @@ void test_dfs() {
 		"...x.",
 		coord(4, 5),
 		{EAST, EAST, EAST, EAST, SOUTH, SOUTH});
+
+	// The boulder can't be pushed out of the way, so there's no way
+	// past the wall.
+	test_dfs_refutation_once(coord(4, 2),
+		"@x#."
+		"..#.",
+		coord(3, 1));
+	// The slider is up against the wall, so it can't be pushed, and
+	// there's no way around it.
+	test_dfs_refutation_once(coord(3, 3),
+		"@#."
+		".#."
+		".^.",
+		coord(2, 0));
+	// The end square can be reached if the boulder is ignored, but it
+	// can only be pushed down, onto the end square, where the wall and
+	// border keep it. Showing that takes searching everything.
+	test_dfs_refutation_once(coord(4, 3),
+		"@..."
+		"...x"
+		"..#.",
+		coord(3, 2), true);
+
+	// Pushing a chain of boulders and sliders: where two neighbours in
+	// it are the same, the square between them doesn't change.
+	test_move_effects(board_from_str(coord(7, 4),
+		"@xx>x.."
+		".x....."
+		".^....."
+		"......."),
+		{EAST, EAST, WEST, WEST, SOUTH, SOUTH, SOUTH, EAST, NORTH});
+	std::cout << "Move effects are OK" << std::endl;
+
+	test_corpus();
 }
 
 // Other ideas:
@@ -474,19 +662,191 @@ void test_dfs() {
 // - grow_board: use more observations, e.g. get upper bound on depth required
 //		to check if the slider puzzle is solvable, by doing the standard IDDFS
 //		with every slider turned into a boulder - if that puzzle isn't
-//		solvable, then the one with sliders isn't either.
-// - Memory-bounded transposition table.
+//		solvable, then the one with sliders isn't either. [Tried, but slower;
+//		see the README]
+// - Memory-bounded transposition table. [DONE]
 // - SMT solver (???)
 // - "Endgame tablebases" of some sort: configurations around the end square that
 //		imply that the configuration is unsolvable even if the rest of the board
 //		is empty. (e.g. 3x3 region centered on end square, with space, boulder, solid;
-//		--> 3^9 = 19683 configurations. With sliders too: 1.9 million)
+//		--> 3^9 = 19683 configurations. With sliders too: 1.9 million) [DONE]
 // - Tree structure-based metrics for estimating difficulty, see the Sokoban
 //		paper: 10.3233/978-1-60750-675-1-140
 
 // But how much should I work on this before I go back to flux_analyze, given
 // that my self-imposed April Fools deadline has passed?
 
+// Everything we find out about the board with a given index.
+struct puzzle_result {
+	uint64_t index = 0;
+	coord size, end_square;
+	zzt_board board;
+	eval_score result;
+	std::vector<direction> solution;
+	uint64_t nodes_visited = 0;
+	relaxation_stats grow_stats;
+
+	// Inputs to the difficulty model, if the board was solved; see
+	// get_difficulty_stats.
+	std::vector<double> stats;
+};
+
+// These are used for my attempts to create a model for how difficult a
+// puzzle is to solve; the more the better (as long as I can endure
+// playing all the puzzles to provide the required data).
+std::vector<double> get_difficulty_stats(const puzzle_result & puzzle) {
+	const std::vector<direction> & solution = puzzle.solution;
+
+	// Go through the solution once for everything that needs it.
+	zzt_board after = puzzle.board;
+	std::vector<move_effect> effects = after.replay(solution);
+
+	double max_change = 0, total_change = 0;
+	for (const move_effect & effect: effects) {
+		max_change = std::max(max_change, (double)effect.tiles_changed);
+		total_change += effect.tiles_changed;
+	}
+	double mean_change = total_change / effects.size();
+
+	return {
+		(double)solution.size(),
+		(double)puzzle.size.x,
+		(double)puzzle.size.y,
+		(double)(puzzle.size.x * puzzle.size.y),
+		(double)get_path_turns(solution),
+		mean_change,
+		max_change,
+		(double)count_changes(puzzle.board, after),
+		(double)count_unusual_moves(puzzle.board, puzzle.end_square,
+			solution),
+		get_unusual_dir_proportion(puzzle.board, puzzle.end_square,
+			solution),
+		1 - get_density(puzzle.board),
+		(double)puzzle.nodes_visited,
+		log(puzzle.nodes_visited)};
+}
+
+puzzle_result grow_and_solve(uint64_t index,
+	const std::vector<solver *> & guiding_solvers, solver & final_solver) {
+
+	puzzle_result puzzle;
+	puzzle.index = index;
+
+	// Vary the size of the board but in a predictable way
+	// so that we don't have to deal with
+	puzzle.size = coord(4 + index % 4, 4 + (index/4) % 4);
+
+	coord player_pos(0, 3);
+	puzzle.end_square = coord(puzzle.size.x-1, puzzle.size.y-1);
+
+	puzzle.board = grow_indexed_board(player_pos, puzzle.end_square,
+		puzzle.size, MAX_DEPTH, guiding_solvers, index, &puzzle.grow_stats);
+
+	puzzle.result = final_solver.solve(puzzle.board, puzzle.end_square,
+		MAX_DEPTH, puzzle.nodes_visited);
+
+	if (puzzle.result.score > 0) {
+		puzzle.solution = final_solver.get_solution();
+		puzzle.stats = get_difficulty_stats(puzzle);
+	}
+
+	return puzzle;
+}
+
+void print_puzzle(const puzzle_result & puzzle) {
+	uint64_t i = puzzle.index;
+	const std::vector<double> & stats = puzzle.stats;
+	const relaxation_stats & grow_stats = puzzle.grow_stats;
+
+	std::cout << "Index is N" << i << std::endl;
+	puzzle.board.print();
+	std::cout << "Index N" << i << ": size: " << puzzle.size.x << ", "
+		<< puzzle.size.y << " = " << puzzle.size.x * puzzle.size.y
+		<< std::endl;
+	std::cout << "Index N" << i << ": Solution score: " << puzzle.result.score << std::endl;
+	std::cout << "Index N" << i << ": turns in solution " << stats[4]
+		<< std::endl;
+	std::cout << "Index N" << i << ": Changes: mean: " << stats[5]
+		<< " max: " << stats[6] << std::endl;
+	std::cout << "Index N" << i << ": Start-finish change count: " <<
+		stats[7] << std::endl;
+	std::cout << "Index N" << i << ": Unusual moves " <<
+		stats[8] << std::endl;
+	std::cout << "Index N" << i << ": Unusual move proportion " <<
+		stats[9] << std::endl;
+	std::cout << "Index N" << i << ": Real sparsity is "
+		<< stats[10] << ", solution in " << puzzle.solution.size()
+		<< "/" << puzzle.result.solution_length << ": ";
+	print_solution(puzzle.solution);
+
+	std::cout << "Index N" << i << ": nodes visited: " << puzzle.nodes_visited << std::endl;
+	std::cout << "Index N" << i << ": grow_board: " <<
+		grow_stats.tiles_tried << " tiles tried, "
+		<< grow_stats.solution_reuses << " kept by the old solution, "
+		<< "rejected by: "
+		<< grow_stats.stuck_on_end << " stuck on end, "
+		<< grow_stats.unreachable << " unreachable, "
+		<< grow_stats.endgame << " endgame, "
+		<< grow_stats.search_refutations << " search ("
+		<< grow_stats.search_nodes << " nodes)" << std::endl;
+
+	std::cout << "Index N" << i << ": summary: ";
+	std::copy(stats.begin(), stats.end(),
+		std::ostream_iterator<double>(std::cout, " "));
+	std::cout << std::endl;
+}
+
+corpus_entry get_corpus_entry(const puzzle_result & puzzle) {
+	corpus_entry entry;
+	entry.index = puzzle.index;
+	entry.seed = puzzle.index == 0 ? RNG_ENTROPY : puzzle.index;
+	entry.max_depth = MAX_DEPTH;
+	entry.board = puzzle.board;
+	entry.end_square = puzzle.end_square;
+	entry.result = puzzle.result;
+	entry.solution = puzzle.solution;
+	entry.stats = puzzle.stats;
+	return entry;
+}
+
+// One line of JSON for batch mode. Unsolved boards get a record too, so
+// that every index in the range has one.
+std::string get_json_record(const puzzle_result & puzzle) {
+	std::ostringstream record;
+	record.precision(std::numeric_limits<double>::max_digits10);
+
+	std::string solution;
+	for (direction dir: puzzle.solution) {
+		solution += str_direction(dir)[0];
+	}
+
+	record << "{\"index\": " << puzzle.index
+		<< ", \"width\": " << puzzle.size.x
+		<< ", \"height\": " << puzzle.size.y
+		<< ", \"board\": \"" << board_to_str(puzzle.board) << "\""
+		<< ", \"score\": " << puzzle.result.score
+		<< ", \"solution_length\": " << puzzle.result.solution_length
+		<< ", \"solution\": \"" << solution << "\""
+		<< ", \"nodes_visited\": " << puzzle.nodes_visited
+		<< ", \"grow_nodes\": " << puzzle.grow_stats.search_nodes
+		<< ", \"stats\": [";
+
+	for (size_t i = 0; i < puzzle.stats.size(); ++i) {
+		if (i > 0) {
+			record << ", ";
+		}
+		// JSON has no NaN or infinity.
+		if (std::isfinite(puzzle.stats[i])) {
+			record << puzzle.stats[i];
+		} else {
+			record << "null";
+		}
+	}
+	record << "]}\n";
+
+	return record.str();
+}
+
 int main(int argc, char ** argv) {
 
 	test_dfs();
@@ -499,106 +859,280 @@ int main(int argc, char ** argv) {
 	std::map<int, std::vector<double> > stats_by_id;
 
 	bool parallel = false;
+	bool use_shared_table = false;
+	bool parallel_solve = false;
+	bool retain_transpositions = true;
+
+	// With an output prefix, we're in batch mode; see batch.h.
+	batch_range range;
+	range.count = 1e7;
+	std::string output_prefix;
+	bool write_corpus = false;
+	bool ordered = false;
+	// Number of tiles to try at once when growing a board.
+	int speculation = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == "--parallel") {
+			parallel = true;
+		}
+		if (std::string(argv[i]) == "--shared-tt") {
+			use_shared_table = true;
+		}
+		if (std::string(argv[i]) == "--parallel-solve") {
+			parallel_solve = true;
+		}
+		// Clear the transposition table between IDDFS iterations,
+		// as we used to. For benchmarking.
+		if (std::string(argv[i]) == "--clear-tt") {
+			retain_transpositions = false;
+		}
+		if (i + 1 < argc && std::string(argv[i]) == "--first") {
+			range.first = std::strtoull(argv[++i], nullptr, 10);
+		}
+		if (i + 1 < argc && std::string(argv[i]) == "--count") {
+			range.count = std::strtoull(argv[++i], nullptr, 10);
+		}
+		if (i + 1 < argc && std::string(argv[i]) == "--shards") {
+			range.shards = std::atoi(argv[++i]);
+		}
+		if (i + 1 < argc && std::string(argv[i]) == "--output") {
+			output_prefix = argv[++i];
+		}
+		// Print the boards in index order, not as they're done.
+		if (std::string(argv[i]) == "--ordered") {
+			ordered = true;
+		}
+		// Write a binary corpus (see corpus.h) instead of JSON.
+		if (std::string(argv[i]) == "--corpus") {
+			write_corpus = true;
+		}
+		if (i + 1 < argc && std::string(argv[i]) == "--speculate") {
+			speculation = std::atoi(argv[++i]);
+		}
+	}
+
+	if (parallel && parallel_solve) {
+		std::cout << "--parallel and --parallel-solve can't be "
+			"combined." << std::endl;
+		return -1;
+	}
+
+	// Speculation uses the threads to grow a single board, so it's no
+	// good if they're already busy.
+	if (speculation > 1 && (parallel || parallel_solve)) {
+		std::cout << "--speculate can't be combined with --parallel or "
+			"--parallel-solve." << std::endl;
+		return -1;
+	}
 
-	if (argc > 1 && std::string(argv[1]) == "--parallel" ) {
+	if (speculation <= 0) {
+		std::cout << "Speculation must be positive." << std::endl;
+		return -1;
+	}
+
+	if (range.shards <= 0) {
+		std::cout << "There must be at least one shard." << std::endl;
+		return -1;
+	}
+
+	if ((range.shards > 1 || write_corpus) && output_prefix.empty()) {
+		std::cout << "--shards and --corpus need --output." << std::endl;
+		return -1;
+	}
+
+	if (parallel_solve) {
+		std::cout << "Using every thread to solve each board." << std::endl;
+	}
+
+	if (parallel) {
 		std::cout << "Enabling parallel mode." << std::endl;
-		parallel = true;
 	} else {
 		std::cout << "Starting serial mode. "
 			"Use --parallel to parallelize." << std::endl;
 	}
 
+	// Refutations shared by all the solvers (and threads) below.
+	// 2^22 slots, or 64 MB.
+	std::unique_ptr<shared_transposition_table> shared_table;
+
+	if (use_shared_table) {
+		std::cout << "Using a shared transposition table." << std::endl;
+		shared_table.reset(new shared_transposition_table(22));
+	}
+
 	dfs_solver dfs;
 	iddfs_solver<dfs_solver> iddfs;
 
+	// Used instead of the above with --parallel-solve.
+	parallel_dfs_solver parallel_dfs;
+	iddfs_solver<parallel_dfs_solver> parallel_iddfs;
+	parallel_dfs.set_shared_table(shared_table.get());
+	parallel_iddfs.set_shared_table(shared_table.get());
+
+	const endgame_table * endgame = &endgame_table::get_default();
+	parallel_dfs.set_endgame_table(endgame);
+	parallel_iddfs.set_endgame_table(endgame);
+
+	auto set_up_solvers = [&](dfs_solver & this_dfs,
+		iddfs_solver<dfs_solver> & this_iddfs) {
+
+		this_dfs.set_shared_table(shared_table.get());
+		this_iddfs.set_shared_table(shared_table.get());
+		this_dfs.set_endgame_table(endgame);
+		this_iddfs.set_endgame_table(endgame);
+		this_dfs.set_transposition_retention(retain_transpositions);
+		this_iddfs.set_transposition_retention(retain_transpositions);
+	};
+
+	// Extra solvers for --speculate; see grow_board. These are only
+	// used in serial mode, so they can be shared by everything below.
+	std::vector<dfs_solver> speculative_dfs(speculation - 1);
+	for (dfs_solver & this_dfs: speculative_dfs) {
+		this_dfs.set_shared_table(shared_table.get());
+		this_dfs.set_endgame_table(endgame);
+		this_dfs.set_transposition_retention(retain_transpositions);
+	}
+
+	auto get_guiding_solvers = [&](solver * guiding_solver) {
+		std::vector<solver *> guiding_solvers = {guiding_solver};
+		for (dfs_solver & this_dfs: speculative_dfs) {
+			guiding_solvers.push_back(&this_dfs);
+		}
+		return guiding_solvers;
+	};
+
+	// In batch mode, every shard is done by one thread, so there's no
+	// need for the threads to wait on each other. The shards are all
+	// opened first so that we can complain about bad checkpoints
+	// before starting on anything.
+	if (!output_prefix.empty()) {
+		std::vector<std::unique_ptr<batch_shard> > shards;
+		try {
+			for (int shard = 0; shard < range.shards; ++shard) {
+				if (write_corpus) {
+					shards.emplace_back(new batch_shard(output_prefix,
+						range, shard, "corpus", std::string(CORPUS_MAGIC,
+							sizeof(CORPUS_MAGIC))));
+				} else {
+					shards.emplace_back(new batch_shard(output_prefix,
+						range, shard, "jsonl"));
+				}
+				std::cout << "Shard " << shard << ": "
+					<< shards.back()->get_completed()
+					<< " boards already done." << std::endl;
+			}
+		} catch (const std::runtime_error & error) {
+			std::cout << error.what() << std::endl;
+			return -1;
+		}
+
+		#pragma omp parallel for if(parallel) schedule(dynamic)
+		for (int shard = 0; shard < range.shards; ++shard) {
+			dfs_solver shard_dfs;
+			iddfs_solver<dfs_solver> shard_iddfs;
+			set_up_solvers(shard_dfs, shard_iddfs);
+
+			solver * guiding_solver = &shard_dfs,
+				* final_solver = &shard_iddfs;
+			if (parallel_solve) {
+				guiding_solver = &parallel_dfs;
+				final_solver = &parallel_iddfs;
+			}
+
+			batch_shard & output = *shards[shard];
+			while (!output.done()) {
+				puzzle_result puzzle = grow_and_solve(
+					output.get_next_index(),
+					get_guiding_solvers(guiding_solver), *final_solver);
+				if (write_corpus) {
+					output.write(encode_corpus_entry(
+						get_corpus_entry(puzzle)));
+				} else {
+					output.write(get_json_record(puzzle));
+				}
+			}
+
+			if (write_corpus) {
+				write_corpus_index(output.get_output_filename());
+			}
+		}
+
+		return 0;
+	}
+
+	// A single writer thread prints the results, so that the solving
+	// threads never have to wait on each other (or on the output) to
+	// hand them over. With --ordered, it holds on to them until it can
+	// print them in index order.
+	mpsc_queue<puzzle_result> results;
+	std::atomic<bool> results_done(false);
+
+	std::thread writer([&]() {
+		std::map<uint64_t, puzzle_result> pending;
+		uint64_t next_index = range.first;
+		puzzle_result puzzle;
+
+		auto write = [&](const puzzle_result & puzzle) {
+			if (puzzle.result.score > 0) {
+				stats_by_id[puzzle.index] = puzzle.stats;
+				print_puzzle(puzzle);
+			}
+		};
+
+		for (;;) {
+			// The solvers are all done before results_done is set,
+			// so if the queue is empty after that, it stays empty.
+			bool done = results_done.load(std::memory_order_acquire);
+
+			while (results.pop(puzzle)) {
+				if (!ordered) {
+					write(puzzle);
+					continue;
+				}
+				uint64_t index = puzzle.index;
+				pending[index] = std::move(puzzle);
+				while (!pending.empty() &&
+					pending.begin()->first == next_index) {
+					write(pending.begin()->second);
+					pending.erase(pending.begin());
+					++next_index;
+				}
+			}
+
+			if (done) {
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+
 	// Apparently using omp parallel like this can cause dfs and iddfs
 	// to have an undefined state once they've been replicated to the
 	// threads. I do this because I don't want to be creating new solvers
 	// in memory all the time (including their expensive transposition tables),
 	// but something more elegant would probably be preferrable.
 	#pragma omp parallel for if(parallel) private(dfs, iddfs) schedule(monotonic:dynamic)
-	// TODO: Make this specifiable from the command line
-	for (int i = 0; i < (int)1e7; ++i) {
-		// Vary the size of the board but in a predictable way
-		// so that we don't have to deal with
-		coord max(4 + i % 4, 4 + (i/4) % 4);
-
-		coord player_pos(0, 3);
-		coord end_square(max.x-1, max.y-1);
-
-		zzt_board test_board =
-			grow_indexed_board(player_pos, end_square,
-				max, MAX_DEPTH, dfs, i);
+	for (uint64_t i = range.first; i < range.first + range.count; ++i) {
+		// The private copies don't inherit anything from the
+		// originals, so this must be done here.
+		set_up_solvers(dfs, iddfs);
+
+		solver * guiding_solver = &dfs, * final_solver = &iddfs;
+		if (parallel_solve) {
+			guiding_solver = &parallel_dfs;
+			final_solver = &parallel_iddfs;
+		}
 
-		uint64_t nodes_visited = 0;
-		eval_score result = iddfs.solve(test_board, end_square,
-			MAX_DEPTH, nodes_visited);
-
-		#pragma omp critical
-		if (result.score > 0 ) {
-			std::vector<direction> solution = iddfs.get_solution();
-
-			// Get some statistics.
-			std::vector<int> changes_with_sol = count_changes(test_board,
-				solution);
-			double max_change = *std::max_element(changes_with_sol.begin(),
-				changes_with_sol.end());
-			double mean_change = std::accumulate(changes_with_sol.begin(),
-				changes_with_sol.end(), 0) / (double)changes_with_sol.size();
-			double solution_turns = get_path_turns(solution);
-			double start_finish_changes = count_start_end_changes(test_board, solution);
-			double unusual_moves = count_unusual_moves(test_board, end_square, solution);
-			double unusual_proportion = get_unusual_dir_proportion(test_board, end_square,
-				solution);
-			double real_board_sparsity = 1 - get_density(test_board);
-
-			// These are used for my attempts to create a model for
-			// how difficult a puzzle is to solve; the more the better
-			// (as long as I can endure playing all the puzzles to provide
-			// the required data).
-			std::vector<double> stats = {
-				(double)solution.size(),
-				(double)max.x,
-				(double)max.y,
-				(double)(max.x * max.y),
-				solution_turns,
-				mean_change,
-				max_change,
-				start_finish_changes,
-				unusual_moves,
-				unusual_proportion,
-				real_board_sparsity,
-				(double)nodes_visited,
-				log(nodes_visited)};
-
-			stats_by_id[i] = stats;
-
-			std::cout << "Index is N" << i << std::endl;
-			test_board.print();
-			std::cout << "Index N" << i << ": size: " << max.x << ", " << max.y
-				<< " = " << max.x * max.y << std::endl;
-			std::cout << "Index N" << i << ": Solution score: " << result.score << std::endl;
-			std::cout << "Index N" << i << ": turns in solution " << solution_turns
-				<< std::endl;
-			std::cout << "Index N" << i << ": Changes: mean: " << mean_change
-				<< " max: " << max_change << std::endl;
-			std::cout << "Index N" << i << ": Start-finish change count: " <<
-				start_finish_changes << std::endl;
-			std::cout << "Index N" << i << ": Unusual moves " <<
-				unusual_moves << std::endl;
-			std::cout << "Index N" << i << ": Unusual move proportion " <<
-				unusual_proportion << std::endl;
-			std::cout << "Index N" << i << ": Real sparsity is "
-				<< real_board_sparsity << ", solution in " << solution.size()
-				<< "/" << result.solution_length << ": ";
-			print_solution(solution);
-
-			std::cout << "Index N" << i << ": nodes visited: " << nodes_visited << std::endl;
-
-			std::cout << "Index N" << i << ": summary: ";
-			std::copy(stats.begin(), stats.end(),
-				std::ostream_iterator<double>(std::cout, " "));
-			std::cout << std::endl;
+		// In ordered mode, the writer needs to see every index to
+		// know that it can go on to the next.
+		puzzle_result puzzle = grow_and_solve(i,
+			get_guiding_solvers(guiding_solver), *final_solver);
+		if (ordered || puzzle.result.score > 0) {
+			results.push(std::move(puzzle));
 		}
 	}
+
+	results_done.store(true, std::memory_order_release);
+	writer.join();
 }
@@ -61,6 +61,6 @@ class rng {
 			return long_rand();
 		}
 
-		uint64_t max() const { return UINT64_MAX; }
-		uint64_t min() const { return 0; }
+		static constexpr uint64_t max() { return UINT64_MAX; }
+		static constexpr uint64_t min() { return 0; }
 };
\ No newline at end of file
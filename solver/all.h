@@ -1,3 +1,5 @@
 #include "solver.h"
 #include "dfs.h"
-#include "iddfs.h"
\ No newline at end of file
+#include "iddfs.h"
+#include "parallel_dfs.h"
+#include "astar.h"
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "astar.h"
+
+#include <algorithm>
+#include <queue>
+
+// Entries on the open list. The priority queue puts the greatest
+// element on top, so "less than" here means "should be expanded later".
+// Among boards with the same estimate, prefer those closer to the goal
+// (further from the start), and then the earliest found, so that the
+// search is deterministic.
+struct open_entry {
+	int estimate;
+	int cost;
+	uint32_t index;
+
+	bool operator<(const open_entry & other) const {
+		if (estimate != other.estimate) {
+			return estimate > other.estimate;
+		}
+		if (cost != other.cost) {
+			return cost < other.cost;
+		}
+		return index > other.index;
+	}
+};
+
+int astar_solver::find_node(uint64_t hash,
+	const uint64_t * board_packed) const {
+
+	uint64_t mask = seen.size() - 1;
+
+	for (uint64_t i = hash & mask; seen[i] != 0; i = (i + 1) & mask) {
+		uint32_t candidate = seen[i] - 1;
+		if (nodes[candidate].hash == hash && std::equal(board_packed,
+			board_packed + packed_size,
+			packed.begin() + candidate * packed_size)) {
+			return candidate;
+		}
+	}
+
+	return -1;
+}
+
+void astar_solver::insert_node(const node & new_node,
+	const uint64_t * board_packed) {
+
+	nodes.push_back(new_node);
+	packed.insert(packed.end(), board_packed, board_packed + packed_size);
+
+	// Keep the load factor at or below 1/2, rebuilding if necessary.
+	if (nodes.size() * 2 > seen.size()) {
+		seen = std::vector<uint32_t>(seen.size() * 2, 0);
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			uint64_t mask = seen.size() - 1, j = nodes[i].hash & mask;
+			while (seen[j] != 0) { j = (j + 1) & mask; }
+			seen[j] = i + 1;
+		}
+		return;
+	}
+
+	uint64_t mask = seen.size() - 1, j = new_node.hash & mask;
+	while (seen[j] != 0) { j = (j + 1) & mask; }
+	seen[j] = nodes.size();
+}
+
+void astar_solver::reconstruct_solution(uint32_t goal_index) {
+	solution.clear();
+
+	for (uint32_t i = goal_index; i != 0; i = nodes[i].parent) {
+		solution.push_back(nodes[i].dir);
+	}
+
+	std::reverse(solution.begin(), solution.end());
+}
+
+std::vector<direction> astar_solver::get_solution() const {
+	if (used_fallback) {
+		return fallback.get_solution();
+	}
+	return solution;
+}
+
+eval_score astar_solver::solve(zzt_board & board,
+	const coord & end_square, int max_solution_length,
+	uint64_t & nodes_visited) {
+
+	solution.clear();
+	used_fallback = false;
+
+	nodes.clear();
+	packed.clear();
+	seen = std::vector<uint32_t>(1 << 12, 0);
+	packed_size = board.get_packed_size();
+
+	std::vector<uint64_t> board_packed(packed_size);
+	std::priority_queue<open_entry> open;
+
+	zzt_board current = board;
+	current.pack(board_packed.data());
+
+	node root = {board.get_hash(), 0, IDLE, 0};
+	insert_node(root, board_packed.data());
+	open.push({(int)end_square.manhattan_dist(board.player_pos), 0, 0});
+
+	// If we skip boards because they can't be solved in time, we can't
+	// say that the puzzle is unsolvable, only that it takes too long.
+	bool hit_horizon = false;
+	int best_evaluation = LOSS;
+
+	while (!open.empty()) {
+		open_entry next = open.top();
+		open.pop();
+
+		// Skip entries that have been superseded by a shorter path.
+		if (next.cost != nodes[next.index].cost) {
+			continue;
+		}
+
+		current.unpack(&packed[next.index * packed_size]);
+		++nodes_visited;
+
+		if (current.player_pos == end_square) {
+			reconstruct_solution(next.index);
+			return eval_score(WIN, next.cost);
+		}
+
+		best_evaluation = std::max(best_evaluation,
+			(int)-end_square.manhattan_dist(current.player_pos));
+
+		for (direction dir: {SOUTH, EAST, WEST, NORTH}) {
+			if (!current.do_move(dir)) { continue; }
+
+			int cost = next.cost + 1;
+			int estimate = cost + end_square.manhattan_dist(
+				current.player_pos);
+
+			if (estimate > max_solution_length) {
+				hit_horizon = true;
+				current.undo_move();
+				continue;
+			}
+
+			current.pack(board_packed.data());
+			int index = find_node(current.get_hash(), board_packed.data());
+
+			if (index == -1) {
+				if (nodes.size() >= max_nodes) {
+					used_fallback = true;
+					return fallback.solve(board, end_square,
+						max_solution_length, nodes_visited);
+				}
+				node child = {current.get_hash(), next.index, dir, cost};
+				insert_node(child, board_packed.data());
+				open.push({estimate, cost, (uint32_t)nodes.size() - 1});
+			} else if (nodes[index].cost > cost) {
+				nodes[index].cost = cost;
+				nodes[index].parent = next.index;
+				nodes[index].dir = dir;
+				open.push({estimate, cost, (uint32_t)index});
+			}
+
+			current.undo_move();
+		}
+	}
+
+	if (hit_horizon) {
+		return eval_score(best_evaluation, max_solution_length);
+	}
+
+	// We've seen every board reachable from the start.
+	return eval_score(LOSS, 0);
+}
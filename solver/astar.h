@@ -0,0 +1,64 @@
+#pragma once
+
+#include "solver.h"
+#include "dfs.h"
+
+// A* search over the graph of boards, using the Manhattan distance from
+// the player to the end square as the heuristic. This never overestimates
+// since the player moves one square at a time, so the first solution found
+// is the shortest one. Unlike IDDFS, each board is only expanded once, no
+// matter how many ways there are to get to it, and the search doesn't have
+// to redo everything when the depth limit increases.
+
+// Boards are stored packed (see zzt_board::pack), and the closed set is an
+// open-addressed hash table of indices into that store. If the search grows
+// beyond max_nodes, we fall back to DFS.
+
+class astar_solver : public solver {
+	private:
+		// Every board we've seen, in order of discovery. The packed
+		// tiles are in a separate array with packed_size words each.
+		struct node {
+			uint64_t hash;
+			uint32_t parent;
+			direction dir;
+			int cost;			// moves from the start
+		};
+
+		std::vector<node> nodes;
+		std::vector<uint64_t> packed;
+		int packed_size = 0;
+
+		// Closed set: node index + 1 for each slot, 0 if empty.
+		std::vector<uint32_t> seen;
+
+		size_t max_nodes = 1 << 22;
+
+		dfs_solver fallback;
+		bool used_fallback = false;
+
+		std::vector<direction> solution;
+
+		// Returns the index of the node with the same board as
+		// the packed one given, or -1 if there is none.
+		int find_node(uint64_t hash, const uint64_t * board_packed) const;
+		void insert_node(const node & new_node,
+			const uint64_t * board_packed);
+
+		void reconstruct_solution(uint32_t goal_index);
+
+	public:
+		std::vector<direction> get_solution() const;
+
+		eval_score solve(zzt_board & board,
+			const coord & end_square, int max_solution_length,
+			uint64_t & nodes_visited);
+
+		void set_shared_table(shared_transposition_table * table) {
+			fallback.set_shared_table(table);
+		}
+
+		void set_max_nodes(size_t max_nodes_in) {
+			max_nodes = max_nodes_in;
+		}
+};
@@ -1,6 +1,7 @@
 #include "dfs.h"
 #include "../board.h"
 #include <algorithm>
+#include <array>
 #include <cmath>
 
 // Get the L1 distance. We'll use this as an evaluation function
@@ -11,85 +12,276 @@ int dfs_solver::evaluate(const zzt_board & board, const coord & end_square) cons
 	return -end_square.manhattan_dist(board.player_pos);
 }
 
-// It would be a good idea to find a way to decisively say "nope, the board
-// is unsolvable" ahead of time. Problem is, I have no idea how. XXX
+// The player can never walk through solids, and sliders and boulders
+// that can never be pushed are as good as solids. A tile can only be
+// pushed along an axis if neither of its neighbors on that axis is such
+// a wall: the player (or the chain he's pushing) has to come from one
+// side, and there has to be room on the other. Sliders only move along
+// one axis, and boulders are walls if they're stuck on both. Walls
+// never move, so once a tile is stuck, it stays stuck, and we can find
+// them all before the search, as can the distances around them. These
+// distances ignore everything that can move, so they never overestimate.
+
+void dfs_solver::find_end_distances(const zzt_board & board,
+	const coord & end_square) {
+
+	coord size = board.get_size(), pos;
+	std::vector<bool> & wall = end_distance_walls;
+	wall.assign(size.x * size.y, false);
+
+	auto is_wall = [&](const coord & where) {
+		if (board.get_tile_at(where) == T_SOLID) {
+			return true;
+		}
+		return where.x >= 0 && where.y >= 0 && where.x < size.x &&
+			where.y < size.y && wall[where.y * size.x + where.x];
+	};
+
+	// A newly stuck tile may make its neighbors stuck too, so keep
+	// going until nothing changes.
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (pos.y = 0; pos.y < size.y; ++pos.y) {
+			for (pos.x = 0; pos.x < size.x; ++pos.x) {
+				int square = pos.y * size.x + pos.x;
+				tile here = board.get_tile_at(pos);
+				if (wall[square] || (here != T_SLIDEREW &&
+					here != T_SLIDERNS && here != T_BOULDER)) {
+					continue;
+				}
+
+				bool stuck_ew = is_wall(pos + get_delta(EAST)) ||
+					is_wall(pos + get_delta(WEST));
+				bool stuck_ns = is_wall(pos + get_delta(NORTH)) ||
+					is_wall(pos + get_delta(SOUTH));
+
+				if ((here == T_SLIDEREW && stuck_ew) ||
+					(here == T_SLIDERNS && stuck_ns) ||
+					(stuck_ew && stuck_ns)) {
+					wall[square] = true;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	// Breadth-first search outwards from the end square.
+	end_distance_width = size.x;
+	end_distance.assign(size.x * size.y, UNREACHABLE);
+	if (is_wall(end_square)) {
+		return;
+	}
+
+	std::vector<coord> & queue = end_distance_queue;
+	queue.assign(1, end_square);
+	end_distance[end_square.y * size.x + end_square.x] = 0;
+
+	for (size_t i = 0; i < queue.size(); ++i) {
+		int distance = get_end_distance(queue[i]);
+		for (direction dir: {NORTH, SOUTH, EAST, WEST}) {
+			coord next = queue[i] + get_delta(dir);
+			if (is_wall(next) || get_end_distance(next) != UNREACHABLE) {
+				continue;
+			}
+			end_distance[next.y * size.x + next.x] = distance + 1;
+			queue.push_back(next);
+		}
+	}
+}
+
+// A board is proven unsolvable if nothing was cut off anywhere in the
+// search; see horizon_cuts.
 
 eval_score dfs_solver::inner_solve(zzt_board & board,
 	const coord & end_square, int max_solution_length,
 	uint64_t & nodes_visited, eval_score & best_score_so_far) {
 
-	// Must be local or move reordering at one depth will
-	// mess with that at another.
-	std::array<std::pair<int, direction>, 4> move_ordering = {
-			std::pair<int, direction>(0, SOUTH),
-			std::pair<int, direction>(0, EAST),
-			std::pair<int, direction>(0, WEST),
-			std::pair<int, direction>(0, NORTH)};
-
 	++nodes_visited;
 
 	if (board.player_pos == end_square) {
 		return eval_score(WIN, 0); // An outright win.
 	}
 
+	// If a solution has been found elsewhere, there's no point in
+	// looking for anything longer.
+	if (win_bound) {
+		int moves_left = win_bound->load(std::memory_order_relaxed) -
+			win_bound_offset - current_ply;
+		if (moves_left < 0) {
+			++horizon_cuts;
+			return eval_score(LOSS, 0);
+		}
+		max_solution_length = std::min(max_solution_length, moves_left);
+	}
+
 	// We hit the horizon, so while the "solution" won't be
-	// an actual solution, it ends here.
+	// an actual solution, it ends here. That means the search
+	// isn't exhaustive, unless everything from here has already
+	// been searched, or is being searched further up.
 	if (max_solution_length <= 0) {
+		transposition_table::lookup known;
+		if (!transposition_enabled) {
+			++horizon_cuts;
+		} else if (on_path(board.get_hash())) {
+			++stack_dependent_results;
+		} else if (transpositions.find(board.get_hash(), known) &&
+			is_proven_loss(known)) {
+			if (!known.proven) {
+				++stack_dependent_results;
+			}
+		} else {
+			++horizon_cuts;
+		}
 		return eval_score(evaluate(board, end_square), 0);
 	}
 
+	// If we can't get to the end square in the moves we have left,
+	// there's no point in trying. If we can't get there at all, that's
+	// not a cut, but a proof.
+	int distance = get_end_distance(board.player_pos);
+	if (distance == UNREACHABLE) {
+		return eval_score(LOSS, max_solution_length);
+	}
+	if (distance > max_solution_length) {
+		++horizon_cuts;
+		return eval_score(evaluate(board, end_square), max_solution_length);
+	}
+
 	// If we have already seen a win, and we're not at a winning
 	// square, abort with a loss because there's no way we can
 	// improve on the current best outcome.
 	if (best_score_so_far == eval_score(WIN, 0)) {
+		++horizon_cuts;
 		return eval_score(LOSS, 0);
 	}
 
 	// Transposition table check: If we have a definite result at
 	// the current state, then there's no need to go down it again.
+	transposition_table::lookup known;
+	direction hint = IDLE;
 	if (transposition_enabled &&
-		(transpositions.find(board.get_hash()) != transpositions.end())) {
+		transpositions.find(board.get_hash(), known)) {
+
+		hint = known.best_move;
 
-		auto pos = transpositions.find(board.get_hash());
 		// If we have a win at this length or shorter, return it
 		// immediately; we can't do better.
-		if (pos->second.score == WIN && pos->second.solution_length <= max_solution_length) {
-			return pos->second;
+		if (known.value.score == WIN &&
+			known.value.solution_length <= max_solution_length) {
+			return known.value;
 		}
+
+		// A proven loss holds at any depth.
+		if (known.proven && known.value.score < WIN) {
+			return eval_score(known.value.score, std::min(
+				known.value.solution_length, max_solution_length));
+		}
+
+		// Returning anything else cuts the search short, unless we
+		// know there's nothing to find.
+		bool proven_loss = is_proven_loss(known);
+
 		// If we have something that's not a win at this length or longer,
 		// return it immediately; we can't do better either.
-		if (pos->second.score < WIN && pos->second.solution_length >= max_solution_length) {
-			return pos->second;
+		// If the entry is exact, we can do better than that: it rules
+		// out a win within the depth it was searched to, even if the
+		// solution length is shorter. (Not so for a loss: other parts
+		// of the tree may have made us ignore everything but that.)
+		// This is only enabled with retention, so that the old behavior
+		// is left unchanged. Entries from earlier solves can be longer
+		// than what we have left, which would overflow the PV, so cut
+		// them down to size.
+		bool reusable = known.value.score < WIN &&
+			known.value.solution_length >= max_solution_length;
+
+		if (retain_transpositions && known.value.score < WIN &&
+			known.exact && known.depth >= max_solution_length) {
+			reusable = true;
+		}
+
+		if (reusable) {
+			if (!proven_loss) {
+				++horizon_cuts;
+			} else {
+				++stack_dependent_results;
+			}
+			if (!known.exact) {
+				++path_dependent_results;
+			}
+			if (!retain_transpositions) {
+				return known.value;
+			}
+			return eval_score(known.value.score, std::min(
+				known.value.solution_length, max_solution_length));
 		}
 	}
 
+	// If the endgame tablebase says there's no way to get to the end
+	// square, then we've lost no matter how many moves we have.
+	if (endgame && endgame->is_refuted(board, end_square)) {
+		return eval_score(LOSS, max_solution_length);
+	}
+
+	// Check if another solver (or an earlier solve) has shown that
+	// there's no win within the moves we have left. If so, pretend we
+	// hit the horizon.
+	if (transposition_enabled && shared_table &&
+		shared_table->get_refuted_depth(board, end_square) >=
+			max_solution_length) {
+		++horizon_cuts;
+		return eval_score(evaluate(board, end_square), max_solution_length);
+	}
+
 	// Looping around without changing the board state is never beneficial,
 	// as we can always remove the loop. So if we visit a square that has
 	// already been seen, count it as an automatic loss.
 	// For some reason, placing this before the TT check makes things *much* slower;
 	// I have no idea why.
-	if (being_processed.find(board.get_hash()) != being_processed.end()) {
+	if (on_path(board.get_hash())) {
+		++path_dependent_results;
 		return eval_score(LOSS, max_solution_length);
 	}
 
 	if (transposition_enabled) {
-		being_processed.insert(board.get_hash());
+		path[current_ply] = board.get_hash();
+		++path_filter[board.get_hash() >> 56];
 	}
 
 	eval_score record_score(LOSS, 0);
+	uint64_t path_dependent_before = path_dependent_results,
+		horizon_cuts_before = horizon_cuts,
+		stack_dependent_before = stack_dependent_results;
 
 	// Determine the move ordering: be greedy and try to go
 	// directly to the target first, i.e. minimizing Manhattan
-	// distance.
-	for (auto & pair: move_ordering) {
-		pair.first = end_square.manhattan_dist(board.player_pos +
-			get_delta(pair.second));
+	// distance. If we have a move ordering, it knows better.
+	// Must be local or move reordering at one depth will
+	// mess with that at another.
+	std::array<direction, 4> order;
+	coord player_pos = board.player_pos;
+
+	if (ordering) {
+		order = ordering->get_move_order(player_pos, end_square,
+			current_ply, hint);
+	} else {
+		std::array<std::pair<int, direction>, 4> by_distance;
+		int i = 0;
+		for (direction dir: {SOUTH, EAST, WEST, NORTH}) {
+			by_distance[i++] = std::pair<int, direction>(
+				end_square.manhattan_dist(player_pos + get_delta(dir)),
+				dir);
+		}
+
+		std::sort(by_distance.begin(), by_distance.end());
+		for (i = 0; i < 4; ++i) {
+			order[i] = by_distance[i].second;
+		}
 	}
 
-	std::sort(move_ordering.begin(), move_ordering.end());
+	direction best_move = IDLE;
 
-	for (auto & pair: move_ordering) {
-		direction dir = pair.second;
+	for (direction dir: order) {
 		if (!board.do_move(dir)) { continue; }
 
 		// We now need to decrease the solution length for the
@@ -98,10 +290,12 @@ eval_score dfs_solver::inner_solve(zzt_board & board,
 		// got one node shorter.
 
 		--best_score_so_far.solution_length;
+		++current_ply;
 
 		eval_score solution_score = inner_solve(board, end_square,
 			max_solution_length-1, nodes_visited, best_score_so_far);
 
+		--current_ply;
 		++best_score_so_far.solution_length;
 
 		if (solution_score.solution_length < 0) {
@@ -113,6 +307,7 @@ eval_score dfs_solver::inner_solve(zzt_board & board,
 
 			record_score = solution_score;
 			best_score_so_far = solution_score;
+			best_move = dir;
 
 			int actual_length = record_score.solution_length + 1;
 
@@ -136,18 +331,19 @@ eval_score dfs_solver::inner_solve(zzt_board & board,
 			// If the record is a win, then we don't care about longer
 			// wins, so adjust the max solution length accordingly.
 			if (record_score.score == WIN) {
+				if (ordering) {
+					ordering->add_win(player_pos, current_ply, dir,
+						max_solution_length);
+				}
 				max_solution_length = std::min(max_solution_length,
 					record_score.solution_length);
-				// The Manhattan distance places a limit on how far
-				// we can go. If we can't possibly get to the end square
-				// in the moves allotted, and the record is a win, then
-				// just break right here. (If the record is not a win,
-				// we could possibly get a better heuristic value.)
-				// It might be possible to prune even more broadly by
-				// making use of the evaluation function being a
-				// Manhattan distance too. Not done yet. XXX
+				// The end distance places a limit on how short a
+				// win can be. If the record is a win and we can't
+				// possibly beat it, then just break right here.
+				// (If the record is not a win, we could possibly get
+				// a better heuristic value.)
 				if (record_score.solution_length <
-					end_square.manhattan_dist(board.player_pos)) {
+					get_end_distance(player_pos)) {
 					max_solution_length = 0;
 				}
 			}
@@ -161,8 +357,33 @@ eval_score dfs_solver::inner_solve(zzt_board & board,
 	record_score.solution_length += 1;
 
 	if (transposition_enabled) {
-		transpositions[board.get_hash()] = record_score;
-		being_processed.erase(board.get_hash());
+		// Non-wins are only independent of the rest of the search if no
+		// win has been found yet, because after that we cut off branches
+		// that can't beat it. So only share them if that's the case.
+		// The same goes for wins found by whoever set the win bound.
+		bool independent = record_score.score < WIN &&
+			best_score_so_far.score < WIN && (!win_bound ||
+				win_bound->load(std::memory_order_relaxed) == NO_WIN_BOUND);
+
+		// To be exact, they must not depend on the path either.
+		bool exact = independent &&
+			path_dependent_results == path_dependent_before;
+		// Likewise, the search below is complete if it wasn't cut short,
+		// and it's proven if it didn't rely on boards further up either.
+		bool complete = horizon_cuts == horizon_cuts_before;
+		bool proven = exact && complete &&
+			stack_dependent_results == stack_dependent_before;
+
+		transpositions.store(board.get_hash(), record_score,
+			max_solution_length, exact, complete, proven, best_move);
+		--path_filter[board.get_hash() >> 56];
+
+		// The shared table outlives this path, so only what doesn't
+		// depend on it goes there.
+		if (shared_table && exact) {
+			shared_table->store_refutation(board, end_square,
+				max_solution_length);
+		}
 	}
 
 	return record_score;
@@ -187,16 +408,64 @@ std::vector<direction> dfs_solver::get_solution() const {
 eval_score dfs_solver::solve(zzt_board & board, const coord & end_square,
 	int max_solution_length, uint64_t & nodes_visited) {
 
-	transpositions.clear();
-	principal_variation = std::vector<std::vector<direction> >(
-		max_solution_length+2, std::vector<direction>(max_solution_length+2, IDLE));
+	// If we're solving the same board as last time, and everything in
+	// the table is exact, then we can keep it.
+	if (!retain_transpositions || !retainable ||
+		board.get_hash() != retained_hash ||
+		end_square != retained_end_square) {
+		transpositions.clear();
+	} else {
+		transpositions.next_solve();
+	}
+
+	// Keep the PV from earlier solves if it's big enough, so that we
+	// don't allocate all over again for every board; but clear the part
+	// we use, as get_solution may read rows that weren't written to.
+	size_t pv_size = max_solution_length+2;
+	if (principal_variation.size() < pv_size) {
+		principal_variation.assign(pv_size,
+			std::vector<direction>(pv_size, IDLE));
+	} else {
+		for (size_t i = 0; i < pv_size; ++i) {
+			std::fill(principal_variation[i].begin(),
+				principal_variation[i].begin() + pv_size, IDLE);
+		}
+	}
+
+	path.resize(max_solution_length+1);
+	find_end_distances(board, end_square);
+	if (ordering) {
+		ordering->start_solve(board.get_size(), max_solution_length);
+	}
+	path_filter.fill(0);
 
 	eval_score bound(LOSS-1, max_solution_length+1);
+	current_ply = 0;
+	horizon_cuts = 0;
 
 	eval_score best = inner_solve(board, end_square, max_solution_length,
 		nodes_visited, bound);
 
+	// If nothing was cut off, we've searched every board that can be
+	// reached, so we've proven that there's no solution. Conversely, a
+	// loss isn't proven if something was, since it may just mean that
+	// nothing beat a better result elsewhere.
+	if (best.score < WIN) {
+		if (horizon_cuts == 0) {
+			best.score = LOSS;
+		} else if (best.score == LOSS) {
+			best.score = evaluate(board, end_square);
+		}
+	}
+
 	last_solution_length = best.solution_length;
 
+	// If there's a win, then anything found after it may have been cut
+	// short, and so might everything if there's a win bound.
+	retainable = best.score < WIN && (!win_bound ||
+		win_bound->load(std::memory_order_relaxed) == NO_WIN_BOUND);
+	retained_hash = board.get_hash();
+	retained_end_square = end_square;
+
 	return best;
 }
\ No newline at end of file
@@ -1,22 +1,91 @@
 #pragma once
 
 #include "solver.h"
-#include <unordered_set>
+#include "shared_table.h"
+#include "transposition_table.h"
+#include "move_ordering.h"
+#include "../endgame.h"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <array>
+
+// Value of a win bound (see set_win_bound) when no solution has
+// been found yet.
+const int NO_WIN_BOUND = std::numeric_limits<int>::max();
+
+// End distance (see dfs_solver::find_end_distances) of squares the
+// player can never get from to the end square.
+const int UNREACHABLE = std::numeric_limits<int>::max();
+
+// Memory used by each solver's own transposition table.
+const size_t DEFAULT_TRANSPOSITION_BYTES = 8 << 20;
 
 class dfs_solver : public solver {
 	private:
-		// The first part of the transposition table is the value
-		// from that position, and the second is the recursion level.
-		// We need to keep track of the recursion level because we
-		// can't accept table matches that are closer to the root
-		// than we are.
-		std::unordered_map<uint64_t, eval_score> transpositions;
-
-		// This set contains the IDs of boards that are already being
-		// processed; this prevents the solver from going in loops.
-		// Doing it like this is slightly faster than using the TT for
-		// everything.
-		std::unordered_set<uint64_t> being_processed;
+		// The transposition table maps board hashes to the value from
+		// that position. The value's solution length tells us how deep
+		// the search was, which we need to know because we can't accept
+		// table matches that are closer to the root than we are.
+		transposition_table transpositions = transposition_table(
+			DEFAULT_TRANSPOSITION_BYTES);
+
+		// The hashes of the boards that are already being processed,
+		// i.e. those on the path from the root to the current board,
+		// indexed by ply; this prevents the solver from going in loops.
+		// The path is never longer than the solution, so this is sized
+		// once per solve. path_filter counts the boards on the path by
+		// the top bits of their hashes: if the count is zero, the board
+		// can't be on the path, and we don't need to look.
+		std::vector<uint64_t> path;
+		std::array<uint16_t, 256> path_filter;
+
+		bool on_path(uint64_t hash) const {
+			if (path_filter[hash >> 56] == 0) {
+				return false;
+			}
+			return std::find(path.begin(), path.begin() + current_ply,
+				hash) != path.begin() + current_ply;
+		}
+
+		// Optional table of refutations shared with other solvers.
+		// We don't own it.
+		shared_transposition_table * shared_table = nullptr;
+
+		// Optional endgame tablebase for rejecting boards that are
+		// unsolvable because of what's around the end square.
+		const endgame_table * endgame = nullptr;
+
+		// Optional move ordering; if there is none, we order by
+		// Manhattan distance alone. We don't own it.
+		move_ordering * ordering = nullptr;
+
+		// Optional length of the shortest solution found elsewhere,
+		// e.g. by another thread searching a different part of the
+		// same tree. win_bound_offset is the number of moves it took
+		// to get to the board we're solving.
+		const std::atomic<int> * win_bound = nullptr;
+		int win_bound_offset = 0;
+
+		// The fewest moves the player needs to get from each square to
+		// the end square, found once per solve; see find_end_distances.
+		// Solves can't win from a square with fewer moves left than
+		// this, so we cut them off there.
+		std::vector<int> end_distance;
+		int end_distance_width = 0;
+		// Kept between solves so they don't have to be allocated again.
+		std::vector<bool> end_distance_walls;
+		std::vector<coord> end_distance_queue;
+
+		void find_end_distances(const zzt_board & board,
+			const coord & end_square);
+
+		int get_end_distance(const coord & pos) const {
+			return end_distance[pos.y * end_distance_width + pos.x];
+		}
+
+		// Number of moves from the board passed to solve().
+		int current_ply = 0;
 
 		std::vector<std::vector<direction> > principal_variation;
 
@@ -31,6 +100,38 @@ class dfs_solver : public solver {
 		bool transposition_enabled = true;
 		int last_solution_length = 0;
 
+		// If true, keep the transposition table between solves of the
+		// same board (e.g. IDDFS iterations), and reuse its exact
+		// entries. retainable says if the last solve's table only has
+		// exact entries, and if so, what it solved.
+		bool retain_transpositions = false;
+		// Loop detection makes results depend on how we got to a
+		// board, so such results aren't exact. This counts the times
+		// that happened (directly or through the table), so we can
+		// tell if it happened anywhere below a node.
+		uint64_t path_dependent_results = 0;
+
+		// The number of times the search was cut short by the horizon
+		// (or something like it: win bounds, table entries searched to
+		// a limited depth) during the current solve. If none, the
+		// search is exhaustive, and a non-win is a proven loss.
+		uint64_t horizon_cuts = 0;
+		// Boards whose search is complete only because what's left is
+		// being searched further up the tree. Like the above, counted
+		// so we can tell if it happened below a node.
+		uint64_t stack_dependent_results = 0;
+
+		// Does the entry show that there's no way to win from its board?
+		// Complete entries do as long as what they relied on further up
+		// is searched to the end too, which it is during the same solve.
+		bool is_proven_loss(const transposition_table::lookup & entry) const {
+			return entry.value.score < WIN &&
+				(entry.proven || (entry.complete && entry.current));
+		}
+		bool retainable = false;
+		uint64_t retained_hash = 0;
+		coord retained_end_square;
+
 	public:
 		std::vector<direction> get_solution() const;
 
@@ -42,4 +143,55 @@ class dfs_solver : public solver {
 		void set_transposition_table_use(bool use) {
 			transposition_enabled = use;
 		}
+
+		// Set the memory budget of the solver's own transposition
+		// table. Takes effect on the next solve.
+		void set_transposition_table_bytes(size_t max_bytes) {
+			transpositions.set_max_bytes(max_bytes);
+			retainable = false;
+		}
+
+		const transposition_table & get_transposition_table() const {
+			return transpositions;
+		}
+
+		// How many times the last solve was cut short; if zero, it
+		// searched everything.
+		uint64_t get_horizon_cuts() const {
+			return horizon_cuts;
+		}
+
+		// Keep the transposition table when solving the same board
+		// again, e.g. to a greater depth. Off by default.
+		void set_transposition_retention(bool retain) {
+			retain_transpositions = retain;
+		}
+
+		// Don't look for solutions longer than what bound says, taking
+		// into account that offset moves were made before the board
+		// passed to solve(). The bound may be lowered during the search,
+		// and should be NO_WIN_BOUND until a solution is found.
+		// Pass nullptr to disable.
+		void set_win_bound(const std::atomic<int> * bound, int offset) {
+			win_bound = bound;
+			win_bound_offset = offset;
+		}
+
+		// Use (or with nullptr, stop using) a table of refutations
+		// shared with other solvers, e.g. in other threads. The table
+		// must outlive the solver.
+		void set_shared_table(shared_transposition_table * table) {
+			shared_table = table;
+		}
+
+		// Use (or with nullptr, stop using) an endgame tablebase.
+		void set_endgame_table(const endgame_table * table) {
+			endgame = table;
+		}
+
+		// Use (or with nullptr, stop using) a move ordering. It learns
+		// as we search, so it must not be shared with other threads.
+		void set_move_ordering(move_ordering * ordering_in) {
+			ordering = ordering_in;
+		}
 };
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "solver.h"
+#include "shared_table.h"
+#include "move_ordering.h"
+#include "../endgame.h"
 
 // Meta-class that turns any solver into an iterative
 // deepening one.
@@ -10,10 +13,34 @@ template<typename T> class iddfs_solver : public solver {
 		T baseline_solver;
 
 	public:
+		// Only available if T has a set_shared_table method.
+		void set_shared_table(shared_transposition_table * table) {
+			baseline_solver.set_shared_table(table);
+		}
+
+		// Likewise for set_endgame_table.
+		void set_endgame_table(const endgame_table * table) {
+			baseline_solver.set_endgame_table(table);
+		}
+
+		// And for set_move_ordering.
+		void set_move_ordering(move_ordering * ordering) {
+			baseline_solver.set_move_ordering(ordering);
+		}
+
+		// And for set_transposition_retention.
+		void set_transposition_retention(bool retain) {
+			baseline_solver.set_transposition_retention(retain);
+		}
+
 		std::vector<direction> get_solution() const {
 			return baseline_solver.get_solution();
 		}
 
+		const T & get_baseline_solver() const {
+			return baseline_solver;
+		}
+
 		eval_score solve(zzt_board & board,
 			const coord & end_square, int recursion_level,
 			uint64_t & nodes_visited) {
@@ -24,7 +51,9 @@ template<typename T> class iddfs_solver : public solver {
 				partial_solve = baseline_solver.
 					solve(board, end_square, i, nodes_visited);
 
-				// If the result is definite, return it.
+				// If the result is definite, return it. The DFS only
+				// returns a loss if it searched everything reachable, so
+				// that's definite too.
 				// TODO: Use some kind of get_win_state instead
 				// of constants so that we can consider different
 				// degrees of victory or failure.
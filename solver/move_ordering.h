@@ -0,0 +1,109 @@
+#pragma once
+
+#include "../board.h"
+
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+#include <array>
+
+// This is a class that suggests what moves to try first. The DFS finds
+// wins sooner if it tries the right move first, and every win it finds
+// limits how far it has to look down the other branches.
+
+// On top of the Manhattan distance to the end square, it uses:
+//	- a hint, e.g. the best move from the transposition table,
+//	- killer moves: the last two moves that led to a win at each ply,
+//	- a history table of how often (and how deep) moving in a given
+//		direction from a given square has led to a win.
+// Each can be turned off. The killers and history are kept between
+// solves so that IDDFS iterations can learn from each other; call clear()
+// to forget them.
+
+class move_ordering {
+	private:
+		coord board_size;
+		std::vector<std::array<direction, 2> > killers;
+		std::vector<std::array<uint32_t, 4> > history;
+
+		int get_square(const coord & pos) const {
+			return pos.y * board_size.x + pos.x;
+		}
+
+	public:
+		bool use_hints = true, use_killers = true, use_history = true;
+
+		void clear() {
+			killers.clear();
+			history.clear();
+		}
+
+		// Get ready for a solve on a board of this size, looking at
+		// most max_ply moves ahead. Forgets everything if the size
+		// has changed.
+		void start_solve(const coord & size, int max_ply) {
+			if (size != board_size) {
+				clear();
+				board_size = size;
+			}
+			if ((int)killers.size() < max_ply + 1) {
+				killers.resize(max_ply + 1, {IDLE, IDLE});
+			}
+			history.resize(size.x * size.y, {0, 0, 0, 0});
+		}
+
+		// Returns the four directions in the order they should be
+		// tried. The hint is ignored if it's IDLE.
+		std::array<direction, 4> get_move_order(const coord & pos,
+			const coord & end_square, int ply, direction hint) const {
+
+			// Lower is tried first: hint, then killers, then the rest
+			// by distance, then by history.
+			std::array<std::pair<uint64_t, direction>, 4> keys;
+			int i = 0;
+
+			for (direction dir: {NORTH, SOUTH, EAST, WEST}) {
+				uint64_t rank = 3;
+				if (use_hints && dir == hint) {
+					rank = 0;
+				} else if (use_killers && dir == killers[ply][0]) {
+					rank = 1;
+				} else if (use_killers && dir == killers[ply][1]) {
+					rank = 2;
+				}
+
+				uint64_t distance = end_square.manhattan_dist(
+					pos + get_delta(dir));
+				uint32_t wins = use_history ?
+					history[get_square(pos)][dir] : 0;
+
+				keys[i++] = {(rank << 48) | (distance << 32) |
+					(UINT32_MAX - wins), dir};
+			}
+
+			std::sort(keys.begin(), keys.end());
+
+			std::array<direction, 4> order;
+			for (i = 0; i < 4; ++i) {
+				order[i] = keys[i].second;
+			}
+			return order;
+		}
+
+		// Record that moving in direction dir from pos, at the given
+		// ply and with moves_left moves to go, led to a win.
+		void add_win(const coord & pos, int ply, direction dir,
+			int moves_left) {
+
+			if (killers[ply][0] != dir) {
+				killers[ply][1] = killers[ply][0];
+				killers[ply][0] = dir;
+			}
+
+			// Wins found with more moves to go say more about the
+			// move, so they count for more.
+			uint32_t & wins = history[get_square(pos)][dir];
+			wins = std::min((uint64_t)UINT32_MAX,
+				wins + (uint64_t)moves_left * moves_left);
+		}
+};
@@ -0,0 +1,147 @@
+#include "parallel_dfs.h"
+
+#include <unordered_set>
+#include <algorithm>
+#include <iterator>
+#include <omp.h>
+
+// A subtree to be searched: the board after the moves in prefix
+// have been made from the root.
+struct split_task {
+	zzt_board board;
+	std::vector<direction> prefix;
+};
+
+eval_score parallel_dfs_solver::solve(zzt_board & board,
+	const coord & end_square, int max_solution_length,
+	uint64_t & nodes_visited) {
+
+	solution.clear();
+
+	++nodes_visited;
+	if (board.player_pos == end_square) {
+		return eval_score(WIN, 0);
+	}
+
+	if (max_solution_length <= 0) {
+		return eval_score(-end_square.manhattan_dist(board.player_pos), 0);
+	}
+
+	// Do a breadth-first search to get the subtrees. Boards that have
+	// already been seen closer to the root are dropped, because any
+	// solution from there is longer than from the earlier copy. If we
+	// find a solution during the BFS, it's the shortest one.
+
+	int num_threads = omp_get_max_threads();
+
+	std::vector<split_task> tasks(1);
+	tasks[0].board = board;
+	std::unordered_set<uint64_t> seen = {board.get_hash()};
+
+	int depth = 0;
+
+	while (!tasks.empty() && depth < max_split_depth &&
+		depth + 1 < max_solution_length &&
+		(int)tasks.size() < tasks_per_thread * num_threads) {
+
+		std::vector<split_task> next_tasks;
+		++depth;
+
+		for (const split_task & task: tasks) {
+			// Same order as in dfs_solver.
+			for (direction dir: {SOUTH, EAST, WEST, NORTH}) {
+				split_task next = task;
+				if (!next.board.do_move(dir)) { continue; }
+
+				++nodes_visited;
+				if (seen.find(next.board.get_hash()) != seen.end()) {
+					continue;
+				}
+				seen.insert(next.board.get_hash());
+				next.prefix.push_back(dir);
+
+				if (next.board.player_pos == end_square) {
+					solution = next.prefix;
+					return eval_score(WIN, depth);
+				}
+
+				next_tasks.push_back(next);
+			}
+		}
+
+		tasks = next_tasks;
+	}
+
+	// Every branch ends before the horizon.
+	if (tasks.empty()) {
+		return eval_score(LOSS, depth);
+	}
+
+	if ((int)workers.size() < num_threads) {
+		workers.resize(num_threads);
+	}
+
+	// The length of the shortest solution found so far, counted
+	// from the root.
+	std::atomic<int> shortest_win(NO_WIN_BOUND);
+
+	std::vector<eval_score> results(tasks.size());
+	std::vector<std::vector<direction> > task_solutions(tasks.size());
+	uint64_t task_nodes = 0;
+
+	#pragma omp parallel for schedule(dynamic, 1) reduction(+:task_nodes)
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		// We can't do better than a solution that's already been
+		// found if we need to make more moves just to get here.
+		if (shortest_win.load() <= depth) {
+			results[i] = eval_score(LOSS, 0);
+			continue;
+		}
+
+		dfs_solver & worker = workers[omp_get_thread_num()];
+		worker.set_shared_table(shared_table);
+		worker.set_endgame_table(endgame);
+		worker.set_win_bound(&shortest_win, depth);
+
+		results[i] = worker.solve(tasks[i].board, end_square,
+			max_solution_length - depth, task_nodes);
+
+		if (results[i].score == WIN) {
+			task_solutions[i] = worker.get_solution();
+
+			int length = depth + results[i].solution_length;
+			int old_shortest = shortest_win.load();
+			while (length < old_shortest &&
+				!shortest_win.compare_exchange_weak(old_shortest, length)) {}
+		}
+
+		worker.set_win_bound(nullptr, 0);
+	}
+
+	nodes_visited += task_nodes;
+
+	// Pick the shortest solution, breaking ties by task order. If
+	// there's no solution, return the best evaluation, or a loss if
+	// every task is a loss.
+	int best_task = -1;
+	eval_score record(LOSS, 0);
+
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		eval_score candidate = results[i];
+		candidate.solution_length += depth;
+
+		if (best_task == -1 || candidate > record) {
+			record = candidate;
+			best_task = i;
+		}
+	}
+
+	if (record.score == WIN) {
+		solution = tasks[best_task].prefix;
+		std::copy(task_solutions[best_task].begin(),
+			task_solutions[best_task].end(),
+			std::back_inserter(solution));
+	}
+
+	return record;
+}
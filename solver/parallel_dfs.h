@@ -0,0 +1,54 @@
+#pragma once
+
+#include "solver.h"
+#include "dfs.h"
+#include "shared_table.h"
+
+#include <atomic>
+
+// A DFS solver that uses every OpenMP thread on a single board. It
+// does a breadth-first search from the root until there are enough
+// distinct boards to keep the threads busy, then hands each of these
+// subtrees to a dfs_solver in whichever thread is free (OpenMP dynamic
+// scheduling). When a thread finds a solution, the others stop looking
+// for longer ones.
+
+// The result doesn't depend on the timing of the threads: we return the
+// shortest solution, and of those, the one from the first subtree.
+
+class parallel_dfs_solver : public solver {
+	private:
+		// One per thread.
+		std::vector<dfs_solver> workers;
+
+		shared_transposition_table * shared_table = nullptr;
+		const endgame_table * endgame = nullptr;
+
+		// Split until we have this many subtrees per thread...
+		int tasks_per_thread = 8;
+		// ... or we're this deep.
+		int max_split_depth = 6;
+
+		std::vector<direction> solution;
+
+	public:
+		std::vector<direction> get_solution() const {
+			return solution;
+		}
+
+		eval_score solve(zzt_board & board,
+			const coord & end_square, int max_solution_length,
+			uint64_t & nodes_visited);
+
+		void set_shared_table(shared_transposition_table * table) {
+			shared_table = table;
+		}
+
+		void set_endgame_table(const endgame_table * table) {
+			endgame = table;
+		}
+
+		void set_tasks_per_thread(int tasks) {
+			tasks_per_thread = tasks;
+		}
+};
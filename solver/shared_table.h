@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../board.h"
+
+#include <stdint.h>
+#include <stdexcept>
+#include <atomic>
+#include <memory>
+
+// A fixed-size transposition table that can be shared by solvers in
+// different threads without any locking.
+
+// It only records refutations: "there's no win within n moves from
+// this position". Unlike most of what the per-solve table in dfs_solver
+// stores, these don't depend on the bounds found elsewhere in the
+// search, so they stay valid across solves, across IDDFS iterations,
+// and across threads solving the same board. Refutations that relied on
+// cutting off a board repeated on the path aren't stored: the way to
+// win may go through that board, just not along this path.
+
+// Each slot stores the data next to key XOR data. If two threads write
+// to the same slot at once, we may read the data from one and the check
+// from the other, but then the key doesn't match and it's treated as a
+// miss. This is the lockless hashing trick from Hyatt and Mann.
+
+class shared_transposition_table {
+	private:
+		struct slot {
+			std::atomic<uint64_t> check;
+			std::atomic<uint64_t> data;
+		};
+
+		std::unique_ptr<slot[]> slots;
+		uint64_t mask;
+
+		// The same board can have different outcomes depending on
+		// where the end square is, so fold it into the key.
+		uint64_t get_key(const zzt_board & board,
+			const coord & end_square) const {
+
+			uint64_t end_idx = 1 + end_square.y * (MAX_BOARD_DIM + 1) +
+				end_square.x;
+			return board.get_hash() ^ (end_idx * 0x9E3779B97F4A7C15ULL);
+		}
+
+	public:
+		// The table has 2^log2_slots slots of 16 bytes each.
+		shared_transposition_table(int log2_slots) {
+			if (log2_slots < 1 || log2_slots > 40) {
+				throw std::invalid_argument("shared_transposition_table: "
+					"invalid size");
+			}
+
+			mask = (1ULL << log2_slots) - 1;
+			slots.reset(new slot[mask + 1]);
+
+			for (uint64_t i = 0; i <= mask; ++i) {
+				slots[i].check.store(0, std::memory_order_relaxed);
+				slots[i].data.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		// Returns the number of moves within which the board is known
+		// to have no solution, or -1 if we know nothing about it.
+		int get_refuted_depth(const zzt_board & board,
+			const coord & end_square) const {
+
+			uint64_t key = get_key(board, end_square);
+			const slot & where = slots[key & mask];
+
+			uint64_t data = where.data.load(std::memory_order_relaxed);
+			uint64_t check = where.check.load(std::memory_order_relaxed);
+
+			// Data zero is an empty slot.
+			if (data == 0 || (check ^ data) != key) {
+				return -1;
+			}
+
+			return (int)data - 1;
+		}
+
+		// Record that there's no win within depth moves. If the slot
+		// already holds a deeper refutation of the same board, keep that
+		// one; otherwise always replace.
+		void store_refutation(const zzt_board & board,
+			const coord & end_square, int depth) {
+
+			uint64_t key = get_key(board, end_square);
+			slot & where = slots[key & mask];
+
+			uint64_t old_data = where.data.load(std::memory_order_relaxed);
+			uint64_t old_check = where.check.load(std::memory_order_relaxed);
+
+			if (old_data != 0 && (old_check ^ old_data) == key &&
+				(int)old_data - 1 >= depth) {
+				return;
+			}
+
+			uint64_t data = depth + 1;
+			where.data.store(data, std::memory_order_relaxed);
+			where.check.store(key ^ data, std::memory_order_relaxed);
+		}
+};
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "../board.h"
-#include <vector>
 #include <unordered_map>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <vector>
 
 const int WIN = 1e9 - 1, LOSS = -1e9;
 
@@ -65,15 +68,12 @@ namespace std {
 	};
 }
 
-// This is a class that suggests what moves to try first for
-// different player positions. Note that it produces a mapping
-// from player positions to an ordering of the moves, so it
-// can't take changing game state into account.
-class move_ordering {
-	public:
-		std::vector<std::vector<
-			std::vector<direction> > > move_hint;
-		std::vector<direction> get_move_order(coord pos) const;
+// What solve_batch (below) found for each board.
+struct solve_result {
+	eval_score score;
+	// Only if the board was solved.
+	std::vector<direction> solution;
+	uint64_t nodes_visited = 0;
 };
 
 class solver {
@@ -82,4 +82,41 @@ class solver {
 		virtual eval_score solve(zzt_board & board,
 			const coord & end_square, int max_solution_length,
 			uint64_t & nodes_visited) = 0;
+
+		// Solve every board (with the end square of the same index),
+		// and return the results in the same order. Boards of the same
+		// size are solved one after another, in order, so that what the
+		// solver keeps between solves (buffers, move ordering) is only
+		// set up once per size. The boards are left as they were.
+		std::vector<solve_result> solve_batch(std::vector<zzt_board> & boards,
+			const std::vector<coord> & end_squares,
+			int max_solution_length) {
+
+			if (boards.size() != end_squares.size()) {
+				throw std::invalid_argument("solve_batch: need an end "
+					"square for every board");
+			}
+
+			std::vector<size_t> order(boards.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(),
+				[&](size_t a, size_t b) {
+					coord size_a = boards[a].get_size(),
+						size_b = boards[b].get_size();
+					return size_a.y < size_b.y ||
+						(size_a.y == size_b.y && size_a.x < size_b.x);
+				});
+
+			std::vector<solve_result> results(boards.size());
+			for (size_t i: order) {
+				solve_result & result = results[i];
+				result.score = solve(boards[i], end_squares[i],
+					max_solution_length, result.nodes_visited);
+				if (result.score.score == WIN) {
+					result.solution = get_solution();
+				}
+			}
+
+			return results;
+		}
 };
\ No newline at end of file
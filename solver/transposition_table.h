@@ -0,0 +1,267 @@
+#pragma once
+
+#include "solver.h"
+
+#include <stdint.h>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+
+// A memory-bounded transposition table for a single solver. It's open
+// addressed with a power-of-two number of buckets, each of which has
+// two slots: one that keeps whatever was searched to the greatest depth
+// and one that always takes the newest entry. It's allocated once and
+// then reused, so clearing it between solves is (almost always) O(1).
+
+// Non-wins can be marked exact, meaning that they say something about
+// the board itself rather than about the search that stored them (which
+// may have been cut short by a win elsewhere, or by loop detection). With
+// the depth they were searched to, they give a lower bound on the length
+// of the shortest solution: there's none within depth moves. That stays
+// valid when the same board is searched again to a greater depth.
+
+// Entries can also be marked complete, meaning that nothing below them was
+// cut off by the horizon (or anything else), so that every board reachable
+// from them was searched, or was being searched further up the tree. If
+// they're exact and didn't rely on the latter, they're proven: a non-win
+// is then a proven loss no matter how we get to the board.
+
+// The table can be kept from one solve to the next (see next_solve), in
+// which case lookups say whether the entry is from the current solve.
+
+class transposition_table {
+	private:
+		struct entry {
+			uint64_t key;
+			// See pack_score.
+			int16_t score;
+			int16_t solution_length;
+			// Moves left when the entry was stored; used to decide
+			// what to keep.
+			uint8_t depth;
+			// Entries from before oldest_generation count as empty.
+			// Running out of generations means going through the
+			// whole table, so this gets a byte of its own.
+			uint8_t generation;
+			uint8_t exact : 1;
+			uint8_t complete : 1;
+			uint8_t proven : 1;
+			// The move that led to the value, or IDLE if none did.
+			uint8_t best_move : 3;
+		};
+
+		static const int MAX_GENERATION = 255;
+
+		// Scores other than wins and losses are evaluations, which are
+		// small, so they fit in 16 bits with room for those two.
+		static int16_t pack_score(int score) {
+			if (score == WIN) { return INT16_MAX; }
+			if (score == LOSS) { return INT16_MIN; }
+			if (score <= INT16_MIN || score >= INT16_MAX) {
+				throw std::logic_error("transposition_table: "
+					"score is out of range");
+			}
+			return score;
+		}
+
+		static int unpack_score(int16_t score) {
+			if (score == INT16_MAX) { return WIN; }
+			if (score == INT16_MIN) { return LOSS; }
+			return score;
+		}
+
+		std::vector<entry> entries;
+		uint64_t bucket_mask = 0;
+		size_t max_bytes;
+		uint8_t generation = 0, oldest_generation = 0;
+
+		size_t used_slots = 0;
+		// The most slots used at once since the table was created.
+		size_t peak_used_slots = 0;
+
+		bool is_live(const entry & slot) const {
+			return slot.generation >= oldest_generation &&
+				slot.generation <= generation;
+		}
+
+		void allocate() {
+			// Round down to a power of two number of buckets, but have
+			// at least one.
+			uint64_t buckets = 1;
+			while (buckets * 2 * 2 * sizeof(entry) <= max_bytes) {
+				buckets *= 2;
+			}
+
+			entry empty;
+			empty.key = 0;
+			empty.score = 0;
+			empty.solution_length = 0;
+			empty.depth = 0;
+			empty.generation = 0;
+			empty.exact = false;
+			empty.complete = false;
+			empty.proven = false;
+			empty.best_move = IDLE;
+
+			entries = std::vector<entry>(buckets * 2, empty);
+			bucket_mask = buckets - 1;
+			// Start at generation 1 so that the empty entries are
+			// not live.
+			generation = 1;
+			oldest_generation = 1;
+		}
+
+		void set(entry & slot, uint64_t key, const eval_score & value,
+			int depth, bool exact, bool complete, bool proven,
+			direction best_move) {
+
+			slot.key = key;
+			slot.score = pack_score(value.score);
+			slot.solution_length = value.solution_length;
+			slot.depth = std::min(depth, 255);
+			slot.generation = generation;
+			slot.exact = exact;
+			slot.complete = complete;
+			slot.proven = proven;
+			slot.best_move = best_move;
+		}
+
+		void count_replacement(const entry & slot) {
+			if (is_live(slot)) {
+				++overwrites;
+			} else {
+				++used_slots;
+			}
+		}
+
+	public:
+		struct lookup {
+			eval_score value;
+			int depth;
+			bool exact, complete, proven;
+			direction best_move;
+			// False if the entry was stored by an earlier solve.
+			bool current;
+		};
+
+		// Statistics for tuning the table size.
+		uint64_t hits = 0;
+		uint64_t collisions = 0;	// lookups that found another board
+		uint64_t overwrites = 0;	// live entries thrown out by stores
+
+		transposition_table(size_t max_bytes_in) {
+			set_max_bytes(max_bytes_in);
+		}
+
+		// Set the memory budget. This clears the table.
+		void set_max_bytes(size_t max_bytes_in) {
+			if (max_bytes_in < 2 * sizeof(entry)) {
+				throw std::invalid_argument("transposition_table: "
+					"budget is too small for even a single bucket");
+			}
+			max_bytes = max_bytes_in;
+			entries.clear();
+			used_slots = 0;
+		}
+
+		size_t get_max_bytes() const { return max_bytes; }
+
+		size_t get_num_slots() const { return entries.size(); }
+		size_t get_used_slots() const { return used_slots; }
+		size_t get_peak_used_slots() const {
+			return std::max(peak_used_slots, used_slots);
+		}
+
+		// Forget everything. The memory is allocated on the first
+		// clear so that solvers that are never used don't take up
+		// space.
+		void clear() {
+			if (entries.empty()) {
+				allocate();
+			} else if (generation == MAX_GENERATION) {
+				// Wrapping around would make old entries look live.
+				for (entry & slot: entries) {
+					slot.generation = 0;
+				}
+				generation = 1;
+			} else {
+				++generation;
+			}
+			oldest_generation = generation;
+			peak_used_slots = get_peak_used_slots();
+			used_slots = 0;
+		}
+
+		// Start a new solve, but keep what's in the table. If we run
+		// out of generations, this clears it instead.
+		void next_solve() {
+			if (entries.empty() || generation == MAX_GENERATION) {
+				clear();
+			} else {
+				++generation;
+			}
+		}
+
+		// Returns true and fills in found if there's an entry for key.
+		bool find(uint64_t key, lookup & found) {
+			entry * bucket = &entries[2 * (key & bucket_mask)];
+			bool occupied = false;
+
+			for (int i = 0; i < 2; ++i) {
+				if (!is_live(bucket[i])) { continue; }
+				if (bucket[i].key == key) {
+					found.value = eval_score(unpack_score(bucket[i].score),
+						bucket[i].solution_length);
+					found.depth = bucket[i].depth;
+					found.exact = bucket[i].exact;
+					found.complete = bucket[i].complete;
+					found.proven = bucket[i].proven;
+					found.best_move = (direction)bucket[i].best_move;
+					found.current = bucket[i].generation == generation;
+					++hits;
+					return true;
+				}
+				occupied = true;
+			}
+
+			if (occupied) {
+				++collisions;
+			}
+			return false;
+		}
+
+		void store(uint64_t key, const eval_score & value, int depth,
+			bool exact, bool complete, bool proven,
+			direction best_move = IDLE) {
+			entry * bucket = &entries[2 * (key & bucket_mask)];
+			entry & deepest = bucket[0], & newest = bucket[1];
+
+			// If we already have the board, just update it.
+			for (int i = 0; i < 2; ++i) {
+				if (is_live(bucket[i]) && bucket[i].key == key) {
+					set(bucket[i], key, value, depth, exact, complete, proven,
+						best_move);
+					return;
+				}
+			}
+
+			// If the new entry is at least as deep as the one in the
+			// depth-preferred slot, it goes there, and the old one
+			// moves to the always-replace slot. Otherwise the new one
+			// goes directly into the always-replace slot.
+			if (!is_live(deepest) || depth >= deepest.depth) {
+				if (is_live(deepest)) {
+					count_replacement(newest);
+					newest = deepest;
+				} else {
+					++used_slots;
+				}
+				set(deepest, key, value, depth, exact, complete, proven,
+					best_move);
+			} else {
+				count_replacement(newest);
+				set(newest, key, value, depth, exact, complete, proven,
+					best_move);
+			}
+		}
+};
@@ -8,11 +8,13 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <memory>
 #include <map>
 
 #include <omp.h>
 
 #include "generator.h"
+#include "corpus.h"
 #include "solver/all.h"
 
 // Integer to string. The silly name is because there's
@@ -75,7 +77,15 @@ void convert_puzzle_board(size_t puzzle_number,
 	}
 }
 
-int main() {
+// If given a corpus (see corpus.h), the boards are taken from it when
+// it has them, instead of being grown again; see load_or_grow_board.
+
+int main(int argc, char ** argv) {
+
+	std::unique_ptr<corpus_reader> corpus;
+	if (argc > 1) {
+		corpus.reset(new corpus_reader(argv[1]));
+	}
 
 	// Set up a world to write to.
 
@@ -124,8 +134,8 @@ int main() {
 		coord player_pos(0, 3);
 		coord end_square(max.x-1, max.y-1);
 
-		zzt_board output_board = grow_indexed_board(player_pos, end_square,
-			max, 30, dfs, board_to_generate);
+		zzt_board output_board = load_or_grow_board(corpus.get(),
+			board_to_generate, player_pos, end_square, max, 30, dfs);
 
 		#pragma omp critical
 		{